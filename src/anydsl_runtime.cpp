@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <random>
 #include <chrono>
 #include <locale>
@@ -88,6 +89,21 @@ void* anydsl_alloc(int32_t mask, int64_t size) {
     return runtime().alloc(to_platform(mask), to_device(mask), size);
 }
 
+void* anydsl_alloc_ex(int32_t mask, int64_t size, const anydsl_alloc_props* props) {
+    AllocProps alloc_props = {};
+    if (props) {
+        alloc_props.alignment = props->alignment;
+        alloc_props.flags     = props->flags;
+        alloc_props.numa_node = props->numa_node;
+        alloc_props.usage     = props->usage;
+    }
+    return runtime().alloc_ex(to_platform(mask), to_device(mask), size, alloc_props);
+}
+
+void* anydsl_alloc_pitched(int32_t mask, int64_t width, int64_t height, int64_t depth, int64_t* pitch) {
+    return runtime().alloc_pitched(to_platform(mask), to_device(mask), width, height, depth, *pitch);
+}
+
 void* anydsl_alloc_host(int32_t mask, int64_t size) {
     return runtime().alloc_host(to_platform(mask), to_device(mask), size);
 }
@@ -104,10 +120,54 @@ void anydsl_release(int32_t mask, void* ptr) {
     runtime().release(to_platform(mask), to_device(mask), ptr);
 }
 
+void anydsl_release_deferred(int32_t mask, void* ptr) {
+    runtime().release_deferred(to_platform(mask), to_device(mask), ptr);
+}
+
 void anydsl_release_host(int32_t mask, void* ptr) {
     runtime().release_host(to_platform(mask), to_device(mask), ptr);
 }
 
+void* anydsl_alloc_shared(const char* name, int64_t size, int32_t flags) {
+    return runtime().alloc_shared(name, size, flags);
+}
+
+void* anydsl_open_shared(const char* name, int64_t* size) {
+    return runtime().open_shared(name, *size);
+}
+
+void* anydsl_alloc_reserve(int32_t mask, int64_t max_size) {
+    return runtime().alloc_reserve(to_platform(mask), to_device(mask), max_size);
+}
+
+void anydsl_commit(int32_t mask, void* ptr, int64_t size) {
+    runtime().commit(to_platform(mask), to_device(mask), ptr, size);
+}
+
+void anydsl_decommit(int32_t mask, void* ptr, int64_t size) {
+    runtime().decommit(to_platform(mask), to_device(mask), ptr, size);
+}
+
+void* anydsl_realloc(int32_t mask, void* ptr, int64_t old_size, int64_t new_size) {
+    return runtime().realloc(to_platform(mask), to_device(mask), ptr, old_size, new_size);
+}
+
+void* anydsl_snapshot(int32_t mask, const void* ptr, int64_t size) {
+    return runtime().snapshot(to_platform(mask), to_device(mask), ptr, size);
+}
+
+void* anydsl_alloc_evictable(int32_t mask, int64_t size) {
+    return runtime().alloc_evictable(to_platform(mask), to_device(mask), size);
+}
+
+int32_t anydsl_host_register(int32_t mask, void* ptr, int64_t size, int32_t flags) {
+    return runtime().host_register(to_platform(mask), to_device(mask), ptr, size, flags) ? 1 : 0;
+}
+
+void anydsl_host_unregister(int32_t mask, void* ptr) {
+    runtime().host_unregister(to_platform(mask), to_device(mask), ptr);
+}
+
 void anydsl_copy(
     int32_t mask_src, const void* src, int64_t offset_src,
     int32_t mask_dst, void* dst, int64_t offset_dst, int64_t size) {
@@ -116,6 +176,100 @@ void anydsl_copy(
         to_platform(mask_dst), to_device(mask_dst), dst, offset_dst, size);
 }
 
+void anydsl_copy_3d(
+    int32_t mask_src, const void* src, int64_t src_row_pitch, int64_t src_slice_pitch,
+    int32_t mask_dst, void* dst, int64_t dst_row_pitch, int64_t dst_slice_pitch,
+    const anydsl_region_3d* region) {
+    Region3D box = {
+        region->src_x, region->src_y, region->src_z,
+        region->dst_x, region->dst_y, region->dst_z,
+        region->width, region->height, region->depth
+    };
+    runtime().copy_3d(
+        to_platform(mask_src), to_device(mask_src), src, Pitch { src_row_pitch, src_slice_pitch },
+        to_platform(mask_dst), to_device(mask_dst), dst, Pitch { dst_row_pitch, dst_slice_pitch }, box);
+}
+
+void anydsl_copy_convert(
+    int32_t mask_src, const void* src, int32_t src_type,
+    int32_t mask_dst, void* dst, int32_t dst_type,
+    int64_t count, float scale, float bias) {
+    runtime().copy_convert(
+        to_platform(mask_src), to_device(mask_src), src, static_cast<ElemType>(src_type),
+        to_platform(mask_dst), to_device(mask_dst), dst, static_cast<ElemType>(dst_type),
+        count, scale, bias);
+}
+
+void anydsl_copy_batch(int32_t count, const anydsl_copy_desc* descs) {
+    // Group the regions by pair of devices, so that each group is submitted at once
+    std::vector<std::pair<std::pair<int32_t, int32_t>, std::vector<CopyRegion>>> groups;
+    for (int32_t i = 0; i < count; ++i) {
+        auto& desc = descs[i];
+        auto devices = std::make_pair(desc.src_device, desc.dst_device);
+        auto it = std::find_if(groups.begin(), groups.end(), [&] (auto& group) { return group.first == devices; });
+        if (it == groups.end())
+            it = groups.emplace(groups.end(), devices, std::vector<CopyRegion>());
+        it->second.push_back(CopyRegion { desc.src, desc.src_offset, desc.dst, desc.dst_offset, desc.size });
+    }
+    for (auto& [devices, regions] : groups) {
+        runtime().copy_batch(
+            to_platform(devices.first), to_device(devices.first),
+            to_platform(devices.second), to_device(devices.second), regions);
+    }
+}
+
+void anydsl_memset(int32_t mask, void* ptr, int64_t offset, const void* value, int64_t pattern_size, int64_t size) {
+    runtime().memset(to_platform(mask), to_device(mask), ptr, offset, value, pattern_size, size);
+}
+
+void anydsl_mem_advise(int32_t mask, void* ptr, int64_t size, int32_t advice) {
+    runtime().mem_advise(to_platform(mask), to_device(mask), ptr, size, static_cast<MemAdvice>(advice));
+}
+
+void anydsl_mem_prefetch(int32_t mask, void* ptr, int64_t size) {
+    runtime().mem_prefetch(to_platform(mask), to_device(mask), ptr, size);
+}
+
+void* anydsl_upload_constant(int32_t mask, const void* host, int64_t size) {
+    return runtime().upload_constant(to_platform(mask), to_device(mask), host, size);
+}
+
+void anydsl_release_constant(int32_t mask, void* ptr) {
+    runtime().release_constant(to_platform(mask), to_device(mask), ptr);
+}
+
+AnyDSLMirror* anydsl_mirror_create(int32_t mask, int64_t size) {
+    return reinterpret_cast<AnyDSLMirror*>(runtime().mirror_create(to_platform(mask), to_device(mask), size));
+}
+
+void* anydsl_mirror_acquire_host(AnyDSLMirror* mirror, int32_t access, int64_t offset, int64_t size) {
+    return runtime().mirror_acquire(reinterpret_cast<Mirror*>(mirror), Mirror::Host, access, offset, size);
+}
+
+void* anydsl_mirror_acquire_device(AnyDSLMirror* mirror, int32_t access, int64_t offset, int64_t size) {
+    return runtime().mirror_acquire(reinterpret_cast<Mirror*>(mirror), Mirror::Device, access, offset, size);
+}
+
+void anydsl_mirror_destroy(AnyDSLMirror* mirror) {
+    runtime().mirror_destroy(reinterpret_cast<Mirror*>(mirror));
+}
+
+AnyDSLArena* anydsl_arena_create(int32_t mask, int64_t capacity) {
+    return reinterpret_cast<AnyDSLArena*>(runtime().arena_create(to_platform(mask), to_device(mask), capacity));
+}
+
+void* anydsl_arena_alloc(AnyDSLArena* arena, int64_t size, int64_t align) {
+    return runtime().arena_alloc(reinterpret_cast<Arena*>(arena), size, align);
+}
+
+void anydsl_arena_reset(AnyDSLArena* arena) {
+    runtime().arena_reset(reinterpret_cast<Arena*>(arena));
+}
+
+void anydsl_arena_destroy(AnyDSLArena* arena) {
+    runtime().arena_destroy(reinterpret_cast<Arena*>(arena));
+}
+
 void anydsl_launch_kernel(
     int32_t mask, const char* file_name, const char* kernel_name,
     const uint32_t* grid, const uint32_t* block,
@@ -146,6 +300,153 @@ void anydsl_synchronize(int32_t mask) {
     runtime().synchronize(to_platform(mask), to_device(mask));
 }
 
+AnyDSLKernel* anydsl_get_kernel(int32_t mask, const char* file_name, const char* kernel_name) {
+    return reinterpret_cast<AnyDSLKernel*>(runtime().get_kernel(to_platform(mask), to_device(mask), file_name, kernel_name));
+}
+
+void anydsl_launch_kernel_handle(
+    AnyDSLKernel* kernel,
+    const uint32_t* grid, const uint32_t* block,
+    void** arg_data,
+    const uint32_t* arg_sizes,
+    const uint32_t* arg_aligns,
+    const uint32_t* arg_alloc_sizes,
+    const uint8_t* arg_types,
+    uint32_t num_args) {
+    LaunchParams launch_params = {
+        nullptr,
+        nullptr,
+        grid,
+        block,
+        {
+            arg_data,
+            arg_sizes,
+            arg_aligns,
+            arg_alloc_sizes,
+            reinterpret_cast<const KernelArgType*>(arg_types),
+        },
+        num_args
+    };
+    runtime().launch_kernel_handle(reinterpret_cast<KernelHandle*>(kernel), launch_params);
+}
+
+int64_t anydsl_kernel_layout(
+    AnyDSLKernel* kernel,
+    const uint32_t* arg_sizes,
+    const uint32_t* arg_aligns,
+    const uint32_t* arg_alloc_sizes,
+    const uint8_t* arg_types,
+    uint32_t num_args,
+    uint32_t* arg_offsets) {
+    ParamsArgs args = {
+        nullptr,
+        arg_sizes,
+        arg_aligns,
+        arg_alloc_sizes,
+        reinterpret_cast<const KernelArgType*>(arg_types),
+    };
+    auto& layout = runtime().kernel_layout(reinterpret_cast<KernelHandle*>(kernel), args, num_args);
+    if (arg_offsets)
+        std::copy(layout.offsets.begin(), layout.offsets.end(), arg_offsets);
+    return layout.size;
+}
+
+void anydsl_launch_kernel_packed(AnyDSLKernel* kernel, const uint32_t* grid, const uint32_t* block, const void* args) {
+    runtime().launch_kernel_packed(reinterpret_cast<KernelHandle*>(kernel), grid, block, args);
+}
+
+AnyDSLStream* anydsl_stream_create(int32_t mask) {
+    return reinterpret_cast<AnyDSLStream*>(runtime().stream_create(to_platform(mask), to_device(mask)));
+}
+
+void anydsl_stream_synchronize(AnyDSLStream* stream) {
+    runtime().stream_synchronize(reinterpret_cast<Stream*>(stream));
+}
+
+void anydsl_stream_destroy(AnyDSLStream* stream) {
+    runtime().stream_destroy(reinterpret_cast<Stream*>(stream));
+}
+
+void anydsl_copy_async(
+    AnyDSLStream* stream,
+    int32_t mask_src, const void* src, int64_t offset_src,
+    int32_t mask_dst, void* dst, int64_t offset_dst, int64_t size) {
+    runtime().copy_async(reinterpret_cast<Stream*>(stream),
+        to_platform(mask_src), to_device(mask_src), src, offset_src,
+        to_platform(mask_dst), to_device(mask_dst), dst, offset_dst, size);
+}
+
+void anydsl_launch_kernel_on(
+    AnyDSLStream* stream, const char* file_name, const char* kernel_name,
+    const uint32_t* grid, const uint32_t* block,
+    void** arg_data,
+    const uint32_t* arg_sizes,
+    const uint32_t* arg_aligns,
+    const uint32_t* arg_alloc_sizes,
+    const uint8_t* arg_types,
+    uint32_t num_args) {
+    LaunchParams launch_params = {
+        file_name,
+        kernel_name,
+        grid,
+        block,
+        {
+            arg_data,
+            arg_sizes,
+            arg_aligns,
+            arg_alloc_sizes,
+            reinterpret_cast<const KernelArgType*>(arg_types),
+        },
+        num_args
+    };
+    runtime().launch_kernel_on(reinterpret_cast<Stream*>(stream), launch_params);
+}
+
+void anydsl_capture_begin(int32_t mask) {
+    runtime().capture_begin(to_platform(mask), to_device(mask));
+}
+
+AnyDSLCommandGraph* anydsl_capture_end() {
+    return reinterpret_cast<AnyDSLCommandGraph*>(runtime().capture_end());
+}
+
+void anydsl_graph_launch(AnyDSLCommandGraph* graph, const anydsl_graph_override* overrides, int32_t num_overrides) {
+    static_assert(sizeof(anydsl_graph_override) == sizeof(GraphOverride), "Graph overrides must match");
+    runtime().graph_launch(reinterpret_cast<CommandGraph*>(graph), reinterpret_cast<const GraphOverride*>(overrides), num_overrides);
+}
+
+void anydsl_graph_destroy(AnyDSLCommandGraph* graph) {
+    runtime().graph_destroy(reinterpret_cast<CommandGraph*>(graph));
+}
+
+AnyDSLEvent* anydsl_event_create(int32_t mask) {
+    return reinterpret_cast<AnyDSLEvent*>(runtime().event_create(to_platform(mask), to_device(mask)));
+}
+
+void anydsl_event_destroy(AnyDSLEvent* event) {
+    runtime().event_destroy(reinterpret_cast<Event*>(event));
+}
+
+void anydsl_event_record(AnyDSLEvent* event, AnyDSLStream* stream) {
+    runtime().event_record(reinterpret_cast<Event*>(event), reinterpret_cast<Stream*>(stream));
+}
+
+void anydsl_event_wait(AnyDSLEvent* event, AnyDSLStream* stream) {
+    runtime().event_wait(reinterpret_cast<Event*>(event), reinterpret_cast<Stream*>(stream));
+}
+
+bool anydsl_event_query(AnyDSLEvent* event) {
+    return runtime().event_query(reinterpret_cast<Event*>(event));
+}
+
+void anydsl_event_synchronize(AnyDSLEvent* event) {
+    runtime().event_synchronize(reinterpret_cast<Event*>(event));
+}
+
+int64_t anydsl_event_elapsed(AnyDSLEvent* start, AnyDSLEvent* end) {
+    return runtime().event_elapsed(reinterpret_cast<Event*>(start), reinterpret_cast<Event*>(end));
+}
+
 uint64_t anydsl_get_micro_time() {
     using namespace std::chrono;
     return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
@@ -26,14 +26,147 @@ AnyDSL_runtime_API void anydsl_info(void);
 AnyDSL_runtime_API const char* anydsl_device_name(int32_t);
 AnyDSL_runtime_API bool anydsl_device_check_feature_support(int32_t, const char*);
 
+enum {
+    ANYDSL_ALLOC_ZERO_INIT  = 1 << 0,
+    ANYDSL_ALLOC_HUGE_PAGES = 1 << 1,
+    ANYDSL_ALLOC_PINNED     = 1 << 2,
+    ANYDSL_ALLOC_NUMA_NODE  = 1 << 3,
+    ANYDSL_ALLOC_SNAPSHOTS  = 1 << 4
+};
+
+enum {
+    ANYDSL_USAGE_READ_WRITE = 0,
+    ANYDSL_USAGE_READ_ONLY  = 1,
+    ANYDSL_USAGE_WRITE_ONLY = 2
+};
+
+// Zero-initialized properties select the defaults of the platform.
+// The NUMA node is only used with ANYDSL_ALLOC_NUMA_NODE.
+// ANYDSL_ALLOC_SNAPSHOTS backs host memory by a memory file, so that anydsl_snapshot() does not copy it.
+typedef struct {
+    int64_t alignment;
+    int32_t flags;
+    int32_t numa_node;
+    int32_t usage;
+} anydsl_alloc_props;
+
 AnyDSL_runtime_API void* anydsl_alloc(int32_t, int64_t);
+AnyDSL_runtime_API void* anydsl_alloc_ex(int32_t, int64_t, const anydsl_alloc_props*);
+AnyDSL_runtime_API void* anydsl_alloc_pitched(int32_t, int64_t, int64_t, int64_t, int64_t*);
 AnyDSL_runtime_API void* anydsl_alloc_host(int32_t, int64_t);
 AnyDSL_runtime_API void* anydsl_alloc_unified(int32_t, int64_t);
 AnyDSL_runtime_API void* anydsl_get_device_ptr(int32_t, void*);
 AnyDSL_runtime_API void  anydsl_release(int32_t, void*);
 AnyDSL_runtime_API void  anydsl_release_host(int32_t, void*);
+// Releases device memory after the work submitted to the device so far, without waiting for it to complete.
+AnyDSL_runtime_API void  anydsl_release_deferred(int32_t, void*);
+
+// Creates host memory that other processes map by name with anydsl_open_shared(), which returns its size.
+// Both are released with anydsl_release(), and releasing the created memory removes its name.
+// The memory can be registered with devices, and ANYDSL_ALLOC_HUGE_PAGES is honored in the flags.
+AnyDSL_runtime_API void* anydsl_alloc_shared(const char*, int64_t, int32_t);
+AnyDSL_runtime_API void* anydsl_open_shared(const char*, int64_t*);
+
+// Reserves room for a buffer that grows up to the given size. Memory is only allocated by anydsl_commit(),
+// which backs the start of the buffer up to the given size without moving it, and freed by anydsl_decommit().
+AnyDSL_runtime_API void* anydsl_alloc_reserve(int32_t, int64_t);
+AnyDSL_runtime_API void  anydsl_commit(int32_t, void*, int64_t);
+AnyDSL_runtime_API void  anydsl_decommit(int32_t, void*, int64_t);
+// Resizes a buffer from its old size to a new size, and returns its new address.
+AnyDSL_runtime_API void* anydsl_realloc(int32_t, void*, int64_t, int64_t);
+
+// Returns a copy of a memory range that is released with anydsl_release(). The copy is made lazily, page by page,
+// for host memory allocated with ANYDSL_ALLOC_SNAPSHOTS. The range must not be modified during the call.
+AnyDSL_runtime_API void* anydsl_snapshot(int32_t, const void*, int64_t);
+
+// Allocates a buffer that is moved to the host when the device runs out of memory, and restored when it is used again.
+// The returned handle can be passed to kernels, anydsl_copy() and anydsl_memset(), and is released with anydsl_release().
+// The device memory can be capped with the ANYDSL_DEVICE_MEMORY_LIMIT environment variable, in bytes.
+AnyDSL_runtime_API void* anydsl_alloc_evictable(int32_t, int64_t);
+
+enum {
+    ANYDSL_HOST_REGISTER_DEFAULT = 0,
+    ANYDSL_HOST_REGISTER_READ_ONLY = 1
+};
+
+// Registers existing host memory for fast transfers and device access through anydsl_get_device_ptr().
+// Returns 0 if the platform does not support it, in which case the memory can still be copied as usual.
+AnyDSL_runtime_API int32_t anydsl_host_register(int32_t, void*, int64_t, int32_t);
+AnyDSL_runtime_API void    anydsl_host_unregister(int32_t, void*);
 
 AnyDSL_runtime_API void anydsl_copy(int32_t, const void*, int64_t, int32_t, void*, int64_t, int64_t);
+// The x coordinates and the width are in bytes.
+typedef struct {
+    int64_t src_x, src_y, src_z;
+    int64_t dst_x, dst_y, dst_z;
+    int64_t width, height, depth;
+} anydsl_region_3d;
+
+// Each buffer is described by its row pitch and slice pitch, in bytes.
+AnyDSL_runtime_API void anydsl_copy_3d(int32_t, const void*, int64_t, int64_t, int32_t, void*, int64_t, int64_t, const anydsl_region_3d*);
+
+enum {
+    ANYDSL_TYPE_U8 = 0,
+    ANYDSL_TYPE_F16 = 1,
+    ANYDSL_TYPE_BF16 = 2,
+    ANYDSL_TYPE_F32 = 3
+};
+
+// Converts elements while copying them, computing `value * scale + bias` in single precision.
+AnyDSL_runtime_API void anydsl_copy_convert(int32_t, const void*, int32_t, int32_t, void*, int32_t, int64_t, float, float);
+
+typedef struct {
+    int32_t src_device;
+    const void* src;
+    int64_t src_offset;
+    int32_t dst_device;
+    void* dst;
+    int64_t dst_offset;
+    int64_t size;
+} anydsl_copy_desc;
+
+// The regions of a batch must not overlap, as they may be copied in any order.
+AnyDSL_runtime_API void anydsl_copy_batch(int32_t, const anydsl_copy_desc*);
+AnyDSL_runtime_API void anydsl_memset(int32_t, void*, int64_t, const void*, int64_t, int64_t);
+
+enum {
+    ANYDSL_ADVICE_READ_MOSTLY = 0,
+    ANYDSL_ADVICE_PREFERRED_LOCATION = 1,
+    ANYDSL_ADVICE_ACCESSED_BY = 2,
+    ANYDSL_ADVICE_SEQUENTIAL = 3,
+    ANYDSL_ADVICE_RANDOM = 4,
+    ANYDSL_ADVICE_WILLNEED = 5,
+    ANYDSL_ADVICE_DONTNEED = 6
+};
+
+AnyDSL_runtime_API void anydsl_mem_advise(int32_t, void*, int64_t, int32_t);
+AnyDSL_runtime_API void anydsl_mem_prefetch(int32_t, void*, int64_t);
+
+enum {
+    ANYDSL_ACCESS_READ = 1,
+    ANYDSL_ACCESS_WRITE = 2,
+    ANYDSL_ACCESS_READ_WRITE = 3
+};
+
+// A buffer mirrored on the host and on a device. Acquiring one side copies the ranges it misses from the other side,
+// and acquiring it for writing marks the given range as modified.
+typedef struct AnyDSLMirror AnyDSLMirror;
+
+AnyDSL_runtime_API AnyDSLMirror* anydsl_mirror_create(int32_t, int64_t);
+AnyDSL_runtime_API void* anydsl_mirror_acquire_host(AnyDSLMirror*, int32_t, int64_t, int64_t);
+AnyDSL_runtime_API void* anydsl_mirror_acquire_device(AnyDSLMirror*, int32_t, int64_t, int64_t);
+AnyDSL_runtime_API void  anydsl_mirror_destroy(AnyDSLMirror*);
+
+// Uploads read-only data, sharing the device buffer with previous uploads of identical contents.
+AnyDSL_runtime_API void* anydsl_upload_constant(int32_t, const void*, int64_t);
+AnyDSL_runtime_API void  anydsl_release_constant(int32_t, void*);
+
+typedef struct AnyDSLArena AnyDSLArena;
+
+AnyDSL_runtime_API AnyDSLArena* anydsl_arena_create(int32_t, int64_t);
+AnyDSL_runtime_API void* anydsl_arena_alloc(AnyDSLArena*, int64_t, int64_t);
+AnyDSL_runtime_API void  anydsl_arena_reset(AnyDSLArena*);
+AnyDSL_runtime_API void  anydsl_arena_destroy(AnyDSLArena*);
 
 AnyDSL_runtime_API void anydsl_launch_kernel(
     int32_t, const char*, const char*,
@@ -42,6 +175,73 @@ AnyDSL_runtime_API void anydsl_launch_kernel(
     uint32_t);
 AnyDSL_runtime_API void anydsl_synchronize(int32_t);
 
+// A kernel loaded once, which is launched without looking it up by name. Handles stay valid until the runtime shuts down.
+typedef struct AnyDSLKernel AnyDSLKernel;
+
+AnyDSL_runtime_API AnyDSLKernel* anydsl_get_kernel(int32_t, const char*, const char*);
+AnyDSL_runtime_API void anydsl_launch_kernel_handle(
+    AnyDSLKernel*,
+    const uint32_t*, const uint32_t*,
+    void**, const uint32_t*, const uint32_t*, const uint32_t*, const uint8_t*,
+    uint32_t);
+// Sets the layout of the packed arguments of a kernel, writes the offset of each argument, and returns their total size.
+// The buffer of packed arguments must be aligned to the largest alignment. Later calls must pass the same arguments.
+AnyDSL_runtime_API int64_t anydsl_kernel_layout(
+    AnyDSLKernel*,
+    const uint32_t*, const uint32_t*, const uint32_t*, const uint8_t*,
+    uint32_t, uint32_t*);
+AnyDSL_runtime_API void anydsl_launch_kernel_packed(AnyDSLKernel*, const uint32_t*, const uint32_t*, const void*);
+
+// A queue of copies and kernel launches on a device, which run in order and asynchronously with the host.
+// Commands issued without a stream are not ordered with the stream, but anydsl_synchronize() waits for both.
+// Host memory passed to anydsl_copy_async() must stay valid and unmodified until the stream is synchronized.
+typedef struct AnyDSLStream AnyDSLStream;
+
+AnyDSL_runtime_API AnyDSLStream* anydsl_stream_create(int32_t);
+AnyDSL_runtime_API void anydsl_stream_synchronize(AnyDSLStream*);
+AnyDSL_runtime_API void anydsl_stream_destroy(AnyDSLStream*);
+AnyDSL_runtime_API void anydsl_copy_async(AnyDSLStream*, int32_t, const void*, int64_t, int32_t, void*, int64_t, int64_t);
+AnyDSL_runtime_API void anydsl_launch_kernel_on(
+    AnyDSLStream*, const char*, const char*,
+    const uint32_t*, const uint32_t*,
+    void**, const uint32_t*, const uint32_t*, const uint32_t*, const uint8_t*,
+    uint32_t);
+
+// Kernel launches and copies captured from the calling thread, which replays run without loading kernels or decoding arguments.
+// Unrelated to the task graphs of anydsl_create_graph().
+typedef struct AnyDSLCommandGraph AnyDSLCommandGraph;
+
+// Replaces an argument of the given captured command. The value of a kernel argument has the size of the argument,
+// or of a pointer for buffers. The arguments of a copy are the source (2 * i) and destination (2 * i + 1) pointers of its regions.
+// The size of the value is given in bytes, and must match the size of the argument.
+typedef struct {
+    int32_t command;
+    int32_t arg;
+    const void* value;
+    int64_t size;
+} anydsl_graph_override;
+
+// Captures the kernel launches and the calls to anydsl_copy() and anydsl_copy_batch() made by the calling thread that involve the device.
+// Captured commands still run.
+AnyDSL_runtime_API void anydsl_capture_begin(int32_t);
+AnyDSL_runtime_API AnyDSLCommandGraph* anydsl_capture_end(void);
+// Replays the captured commands. Replaced arguments keep their new values in later replays.
+AnyDSL_runtime_API void anydsl_graph_launch(AnyDSLCommandGraph*, const anydsl_graph_override*, int32_t);
+AnyDSL_runtime_API void anydsl_graph_destroy(AnyDSLCommandGraph*);
+
+// A point in the commands issued on a device. A NULL stream stands for the commands issued without a stream.
+// Waiting for an event only blocks the host when the stream is on another device than the event.
+typedef struct AnyDSLEvent AnyDSLEvent;
+
+AnyDSL_runtime_API AnyDSLEvent* anydsl_event_create(int32_t);
+AnyDSL_runtime_API void anydsl_event_destroy(AnyDSLEvent*);
+AnyDSL_runtime_API void anydsl_event_record(AnyDSLEvent*, AnyDSLStream*);
+AnyDSL_runtime_API void anydsl_event_wait(AnyDSLEvent*, AnyDSLStream*);
+AnyDSL_runtime_API bool anydsl_event_query(AnyDSLEvent*);
+AnyDSL_runtime_API void anydsl_event_synchronize(AnyDSLEvent*);
+// Returns the time between two events of the same device, in nanoseconds.
+AnyDSL_runtime_API int64_t anydsl_event_elapsed(AnyDSLEvent*, AnyDSLEvent*);
+
 AnyDSL_runtime_API void anydsl_random_seed(uint32_t);
 AnyDSL_runtime_API float    anydsl_random_val_f32();
 AnyDSL_runtime_API uint64_t anydsl_random_val_u64();
@@ -104,6 +104,171 @@ protected:
     int32_t dev_;
 };
 
+/// A 3D array whose rows are padded to the preferred alignment of the device.
+/// Rows are padded to a power of two, so the pitch is a whole number of elements only when the element size is one too.
+template <typename T>
+class PitchedArray : public Array<T> {
+    static_assert((sizeof(T) & (sizeof(T) - 1)) == 0, "element size must be a power of two");
+
+public:
+    PitchedArray(Platform p, Device d, int64_t width, int64_t height, int64_t depth = 1)
+        : width_(width), height_(height), depth_(depth) {
+        this->dev_ = make_device(p, d);
+        this->data_ = (T*)anydsl_alloc_pitched(this->dev_, sizeof(T) * width, height, depth, &pitch_);
+        this->size_ = pitch_ * height * depth / int64_t(sizeof(T));
+    }
+
+    int64_t width() const { return width_; }
+    int64_t height() const { return height_; }
+    int64_t depth() const { return depth_; }
+    /// Returns the number of bytes between consecutive rows.
+    int64_t pitch() const { return pitch_; }
+    /// Returns the number of bytes between consecutive slices.
+    int64_t slice_pitch() const { return pitch_ * height_; }
+
+    const T& operator () (int64_t x, int64_t y, int64_t z = 0) const { return *element(x, y, z); }
+    T& operator () (int64_t x, int64_t y, int64_t z = 0) { return *const_cast<T*>(element(x, y, z)); }
+
+private:
+    const T* element(int64_t x, int64_t y, int64_t z) const {
+        return reinterpret_cast<const T*>(reinterpret_cast<const char*>(this->data_) + z * slice_pitch() + y * pitch_) + x;
+    }
+
+    int64_t width_, height_, depth_, pitch_;
+};
+
+/// A device array that is moved to the host when the device runs out of memory.
+/// Its data is a handle, which can only be passed to kernels, copies, and fills.
+template <typename T>
+class EvictableArray : public Array<T> {
+public:
+    EvictableArray(Platform p, Device d, int64_t size) {
+        this->dev_ = make_device(p, d);
+        this->size_ = size;
+        this->data_ = (T*)anydsl_alloc_evictable(this->dev_, sizeof(T) * size);
+    }
+};
+
+/// An array mirrored on the host and on a device, where each side is only updated when it is stale.
+template <typename T>
+class MirroredArray {
+public:
+    MirroredArray(Platform p, Device d, int64_t size)
+        : size_(size), dev_(make_device(p, d)), mirror_(anydsl_mirror_create(dev_, sizeof(T) * size))
+    {}
+
+    MirroredArray(MirroredArray&& other)
+        : size_(other.size_), dev_(other.dev_), mirror_(other.mirror_) {
+        other.mirror_ = nullptr;
+    }
+
+    MirroredArray& operator = (MirroredArray&& other) {
+        if (mirror_) anydsl_mirror_destroy(mirror_);
+        size_ = other.size_;
+        dev_ = other.dev_;
+        mirror_ = other.mirror_;
+        other.mirror_ = nullptr;
+        return *this;
+    }
+
+    MirroredArray(const MirroredArray&) = delete;
+    MirroredArray& operator = (const MirroredArray&) = delete;
+
+    ~MirroredArray() { if (mirror_) anydsl_mirror_destroy(mirror_); }
+
+    int64_t size() const { return size_; }
+    int32_t device() const { return dev_; }
+
+    /// Returns the host side, up to date. Writes must stay within the given range of elements.
+    T* host(int32_t access = ANYDSL_ACCESS_READ_WRITE) { return host(access, 0, size_); }
+    T* host(int32_t access, int64_t offset, int64_t count) {
+        return (T*)anydsl_mirror_acquire_host(mirror_, access, offset * sizeof(T), count * sizeof(T));
+    }
+
+    /// Returns the device side, up to date. Writes must stay within the given range of elements.
+    T* device_data(int32_t access = ANYDSL_ACCESS_READ_WRITE) { return device_data(access, 0, size_); }
+    T* device_data(int32_t access, int64_t offset, int64_t count) {
+        return (T*)anydsl_mirror_acquire_device(mirror_, access, offset * sizeof(T), count * sizeof(T));
+    }
+
+private:
+    int64_t size_;
+    int32_t dev_;
+    AnyDSLMirror* mirror_;
+};
+
+/// Scratch memory that is allocated once on a device and released all at once.
+class Arena {
+public:
+    Arena(Platform p, Device d, int64_t capacity)
+        : dev_(make_device(p, d)), arena_(anydsl_arena_create(dev_, capacity))
+    {}
+
+    Arena(Arena&& other)
+        : dev_(other.dev_), arena_(other.arena_) {
+        other.arena_ = nullptr;
+    }
+
+    Arena& operator = (Arena&& other) {
+        if (arena_) anydsl_arena_destroy(arena_);
+        dev_ = other.dev_;
+        arena_ = other.arena_;
+        other.arena_ = nullptr;
+        return *this;
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator = (const Arena&) = delete;
+
+    ~Arena() { if (arena_) anydsl_arena_destroy(arena_); }
+
+    int32_t device() const { return dev_; }
+
+    /// Returns memory that lives until the arena is reset or destroyed, or `nullptr` if the arena is exhausted.
+    template <typename T>
+    T* alloc(int64_t size, int64_t align = alignof(T)) {
+        return (T*)anydsl_arena_alloc(arena_, sizeof(T) * size, align);
+    }
+
+    void reset() { anydsl_arena_reset(arena_); }
+
+private:
+    int32_t dev_;
+    AnyDSLArena* arena_;
+};
+
+/// A queue of copies and kernel launches on a device, which run in order and asynchronously with the host.
+class Stream {
+public:
+    Stream(Platform p, Device d)
+        : stream_(anydsl_stream_create(make_device(p, d)))
+    {}
+
+    Stream(Stream&& other)
+        : stream_(other.stream_) {
+        other.stream_ = nullptr;
+    }
+
+    Stream& operator = (Stream&& other) {
+        if (stream_) anydsl_stream_destroy(stream_);
+        stream_ = other.stream_;
+        other.stream_ = nullptr;
+        return *this;
+    }
+
+    Stream(const Stream&) = delete;
+    Stream& operator = (const Stream&) = delete;
+
+    ~Stream() { if (stream_) anydsl_stream_destroy(stream_); }
+
+    AnyDSLStream* handle() const { return stream_; }
+
+    void synchronize() { anydsl_stream_synchronize(stream_); }
+
+private:
+    AnyDSLStream* stream_;
+};
+
 template <typename T>
 void copy(const Array<T>& a, Array<T>& b) {
     anydsl_copy(a.device(), (const void*)a.data(), 0,
@@ -125,6 +290,81 @@ void copy(const Array<T>& a, int64_t offset_a, Array<T>& b, int64_t offset_b, in
                 size * sizeof(T));
 }
 
+/// A point in the commands issued on a device, used to order streams and to time commands.
+class Event {
+public:
+    Event(Platform p, Device d)
+        : event_(anydsl_event_create(make_device(p, d)))
+    {}
+
+    Event(Event&& other)
+        : event_(other.event_) {
+        other.event_ = nullptr;
+    }
+
+    Event& operator = (Event&& other) {
+        if (event_) anydsl_event_destroy(event_);
+        event_ = other.event_;
+        other.event_ = nullptr;
+        return *this;
+    }
+
+    Event(const Event&) = delete;
+    Event& operator = (const Event&) = delete;
+
+    ~Event() { if (event_) anydsl_event_destroy(event_); }
+
+    /// Records the event on the stream, or after the commands issued without a stream.
+    void record(Stream* stream = nullptr) { anydsl_event_record(event_, stream ? stream->handle() : nullptr); }
+    /// Makes the commands issued next on the stream, or without a stream, wait for the event.
+    void wait(Stream* stream = nullptr) { anydsl_event_wait(event_, stream ? stream->handle() : nullptr); }
+    bool query() { return anydsl_event_query(event_); }
+    void synchronize() { anydsl_event_synchronize(event_); }
+
+    /// Returns the time from this event to the given one, in nanoseconds.
+    int64_t elapsed(const Event& end) const { return anydsl_event_elapsed(event_, end.event_); }
+
+private:
+    AnyDSLEvent* event_;
+};
+
+/// Enqueues a copy on the stream. Host arrays must not be modified or destroyed until the stream is synchronized.
+template <typename T>
+void copy_async(Stream& stream, const Array<T>& a, Array<T>& b) {
+    anydsl_copy_async(stream.handle(),
+                      a.device(), (const void*)a.data(), 0,
+                      b.device(), (void*)b.data(), 0,
+                      a.size() * sizeof(T));
+}
+
+template <typename T>
+void copy_async(Stream& stream, const Array<T>& a, int64_t offset_a, Array<T>& b, int64_t offset_b, int64_t size) {
+    anydsl_copy_async(stream.handle(),
+                      a.device(), (const void*)a.data(), offset_a * sizeof(T),
+                      b.device(), (void*)b.data(), offset_b * sizeof(T),
+                      size * sizeof(T));
+}
+
+/// Copies a box of `width * height * depth` elements between pitched arrays.
+template <typename T>
+void copy_3d(const PitchedArray<T>& a, int64_t ax, int64_t ay, int64_t az,
+             PitchedArray<T>& b, int64_t bx, int64_t by, int64_t bz,
+             int64_t width, int64_t height, int64_t depth = 1) {
+    anydsl_region_3d region = {
+        ax * int64_t(sizeof(T)), ay, az,
+        bx * int64_t(sizeof(T)), by, bz,
+        width * int64_t(sizeof(T)), height, depth
+    };
+    anydsl_copy_3d(a.device(), (const void*)a.data(), a.pitch(), a.slice_pitch(),
+                   b.device(), (void*)b.data(), b.pitch(), b.slice_pitch(), &region);
+}
+
+template <typename T>
+void fill(Array<T>& a, const T& value) {
+    static_assert(sizeof(T) <= 128 && (sizeof(T) & (sizeof(T) - 1)) == 0, "element size must be a power of two not larger than 128");
+    anydsl_memset(a.device(), (void*)a.data(), 0, &value, sizeof(T), a.size() * sizeof(T));
+}
+
 } // namespace anydsl
 
 #endif
@@ -0,0 +1,184 @@
+#include "convert.h"
+#include "cpu_platform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CONVERT_HAS_F16C
+#endif
+
+int64_t elem_size(ElemType type) {
+    switch (type) {
+        case ElemType::U8:   return 1;
+        case ElemType::F16:  return 2;
+        case ElemType::BF16: return 2;
+        case ElemType::F32:  return 4;
+    }
+    error("Unknown element type %", static_cast<int32_t>(type));
+}
+
+static uint32_t float_bits(float f) { uint32_t u; memcpy(&u, &f, sizeof(u)); return u; }
+static float bits_float(uint32_t u) { float f; memcpy(&f, &u, sizeof(f)); return f; }
+
+static float half_to_float(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exp  = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    if (exp == 0x1F)
+        return bits_float(sign | 0x7F800000 | (mant << 13));
+    if (exp == 0) {
+        // Subnormals are exactly representable as floats
+        float f = std::ldexp(float(mant), -24);
+        return sign ? -f : f;
+    }
+    return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+static uint16_t float_to_half(float f) {
+    uint32_t u = float_bits(f);
+    uint16_t sign = (u >> 16) & 0x8000;
+    uint32_t abs = u & 0x7FFFFFFF;
+    if (abs >= 0x7F800000)
+        return sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0);
+    if (abs >= 0x477FF000)
+        return sign | 0x7C00;
+    if (abs < 0x38800000) {
+        // Subnormal or zero: rounds to nearest even by letting the FPU add a magic number
+        float magic = bits_float(abs) + 0.5f;
+        return sign | uint16_t(float_bits(magic) - float_bits(0.5f));
+    }
+    uint32_t rounded = abs + 0xFFF + ((abs >> 13) & 1) - (uint32_t(112) << 23);
+    return sign | uint16_t(rounded >> 13);
+}
+
+static float bf16_to_float(uint16_t b) { return bits_float(uint32_t(b) << 16); }
+
+static uint16_t float_to_bf16(float f) {
+    uint32_t u = float_bits(f);
+    if ((u & 0x7FFFFFFF) > 0x7F800000)
+        return uint16_t((u >> 16) | 0x40);
+    return uint16_t((u + 0x7FFF + ((u >> 16) & 1)) >> 16);
+}
+
+#ifdef CONVERT_HAS_F16C
+static bool has_f16c() {
+    static const bool supported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+    return supported;
+}
+
+__attribute__((target("avx,f16c")))
+static void half_to_float_f16c(const uint16_t* src, float* dst, int64_t n) {
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    for (; i < n; ++i)
+        dst[i] = half_to_float(src[i]);
+}
+
+__attribute__((target("avx,f16c")))
+static void float_to_half_f16c(const float* src, uint16_t* dst, int64_t n) {
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    for (; i < n; ++i)
+        dst[i] = float_to_half(src[i]);
+}
+#endif
+
+/// Loads `n` elements as floats.
+static void load_block(ElemType type, const void* src, float* dst, int64_t n) {
+    switch (type) {
+        case ElemType::U8: {
+            auto ptr = static_cast<const uint8_t*>(src);
+            for (int64_t i = 0; i < n; ++i) dst[i] = float(ptr[i]);
+            break;
+        }
+        case ElemType::F16: {
+            auto ptr = static_cast<const uint16_t*>(src);
+            #ifdef CONVERT_HAS_F16C
+            if (has_f16c()) return half_to_float_f16c(ptr, dst, n);
+            #endif
+            for (int64_t i = 0; i < n; ++i) dst[i] = half_to_float(ptr[i]);
+            break;
+        }
+        case ElemType::BF16: {
+            auto ptr = static_cast<const uint16_t*>(src);
+            for (int64_t i = 0; i < n; ++i) dst[i] = bf16_to_float(ptr[i]);
+            break;
+        }
+        case ElemType::F32:
+            memcpy(dst, src, n * sizeof(float));
+            break;
+    }
+}
+
+/// Stores `n` floats as elements of the given type.
+static void store_block(ElemType type, const float* src, void* dst, int64_t n) {
+    switch (type) {
+        case ElemType::U8: {
+            auto ptr = static_cast<uint8_t*>(dst);
+            // Written so that NaNs map to zero
+            for (int64_t i = 0; i < n; ++i) ptr[i] = uint8_t((src[i] > 0.0f ? std::min(src[i], 255.0f) : 0.0f) + 0.5f);
+            break;
+        }
+        case ElemType::F16: {
+            auto ptr = static_cast<uint16_t*>(dst);
+            #ifdef CONVERT_HAS_F16C
+            if (has_f16c()) return float_to_half_f16c(src, ptr, n);
+            #endif
+            for (int64_t i = 0; i < n; ++i) ptr[i] = float_to_half(src[i]);
+            break;
+        }
+        case ElemType::BF16: {
+            auto ptr = static_cast<uint16_t*>(dst);
+            for (int64_t i = 0; i < n; ++i) ptr[i] = float_to_bf16(src[i]);
+            break;
+        }
+        case ElemType::F32:
+            memcpy(dst, src, n * sizeof(float));
+            break;
+    }
+}
+
+void convert(ElemType src_type, const void* src, ElemType dst_type, void* dst, int64_t count, float scale, float bias) {
+    // Elements go through a small block of floats that stays in the L1 cache
+    const int64_t block_size = 1024;
+    alignas(32) float block[block_size];
+    auto src_ptr = static_cast<const char*>(src);
+    auto dst_ptr = static_cast<char*>(dst);
+    int64_t src_size = elem_size(src_type);
+    int64_t dst_size = elem_size(dst_type);
+    bool affine = scale != 1.0f || bias != 0.0f;
+    for (int64_t i = 0; i < count; i += block_size) {
+        int64_t n = std::min(block_size, count - i);
+        load_block(src_type, src_ptr + i * src_size, block, n);
+        if (affine) {
+            for (int64_t j = 0; j < n; ++j)
+                block[j] = block[j] * scale + bias;
+        }
+        store_block(dst_type, block, dst_ptr + i * dst_size, n);
+    }
+}
+
+void parallel_convert(ElemType src_type, const void* src, ElemType dst_type, void* dst, int64_t count, float scale, float bias) {
+    // Below this number of elements, dispatching the workers costs more than it saves
+    const int64_t min_elems_per_task = int64_t(64) << 10;
+    int32_t num_tasks = int32_t(std::min<int64_t>(std::max(1u, std::thread::hardware_concurrency()), count / min_elems_per_task));
+    if (num_tasks <= 1)
+        return convert(src_type, src, dst_type, dst, count, scale, bias);
+
+    auto src_ptr = static_cast<const char*>(src);
+    auto dst_ptr = static_cast<char*>(dst);
+    int64_t chunk = (count + num_tasks - 1) / num_tasks;
+    parallel_tasks(num_tasks, [&] (int32_t i) {
+        int64_t begin = std::min(count, i * chunk);
+        int64_t end   = std::min(count, begin + chunk);
+        convert(src_type, src_ptr + begin * elem_size(src_type),
+                dst_type, dst_ptr + begin * elem_size(dst_type),
+                end - begin, scale, bias);
+    });
+}
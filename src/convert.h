@@ -0,0 +1,18 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include "runtime.h"
+
+#include <cstdint>
+
+/// Returns the size in bytes of an element of the given type.
+int64_t elem_size(ElemType type);
+
+/// Converts `count` elements from `src` to `dst`, computing `value * scale + bias` in single precision.
+/// Conversions to `U8` round to the nearest integer and saturate.
+void convert(ElemType src_type, const void* src, ElemType dst_type, void* dst, int64_t count, float scale, float bias);
+
+/// Same as `convert()`, but splits large conversions over the persistent host workers of `parallel_tasks()`.
+void parallel_convert(ElemType src_type, const void* src, ElemType dst_type, void* dst, int64_t count, float scale, float bias);
+
+#endif
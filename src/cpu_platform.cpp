@@ -1,11 +1,24 @@
+#include "anydsl_runtime.h"
 #include "cpu_platform.h"
 #include "runtime.h"
 
 #include <cstddef>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <iterator>
+#include <limits>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CPU_PLATFORM_HAS_STREAMING_STORES
+#endif
 
 #if defined(__APPLE__)
 #include <sys/types.h>
@@ -16,6 +29,27 @@
 #include <windows.h>
 #endif
 
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 1
+#endif
+#if defined(__linux__) && !defined(MADV_POPULATE_READ)
+#define MADV_POPULATE_READ 22
+#endif
+
 CpuPlatform::CpuPlatform(Runtime* runtime)
     : Platform(runtime)
 {
@@ -69,3 +103,1025 @@ CpuPlatform::CpuPlatform(Runtime* runtime)
     std::getline(cpuinfo >> std::ws, device_name_);
     #endif
 }
+
+// Copies below this size are always done with a single `memcpy()`
+static constexpr int64_t min_copy_threshold = int64_t(1) << 20;
+
+CpuPlatform::~CpuPlatform() {
+    if (prefetcher_.thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(prefetcher_.lock);
+            prefetcher_.ranges.clear();
+            prefetcher_.stop = true;
+        }
+        prefetcher_.cond.notify_all();
+        prefetcher_.thread.join();
+    }
+}
+
+#ifndef _WIN32
+/// Extends the given range to page boundaries, as required by `posix_madvise()`.
+static std::pair<char*, size_t> page_range(void* ptr, int64_t size) {
+    auto begin = reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(PAGE_SIZE - 1);
+    auto end = (reinterpret_cast<uintptr_t>(ptr) + size + PAGE_SIZE - 1) & ~uintptr_t(PAGE_SIZE - 1);
+    return { reinterpret_cast<char*>(begin), end - begin };
+}
+#endif
+
+#ifndef _WIN32
+/// Applies the placement properties of an allocation to its pages.
+static void apply_page_props(char* ptr, size_t length, const AllocProps& props) {
+    #ifdef MADV_HUGEPAGE
+    if ((props.flags & AllocProps::HugePages) && madvise(ptr, length, MADV_HUGEPAGE) != 0)
+        debug("madvise(MADV_HUGEPAGE) failed for % bytes", length);
+    #endif
+    #if defined(__linux__) && defined(SYS_mbind)
+    if (props.flags & AllocProps::NumaNode) {
+        const size_t bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> node_mask(props.numa_node / bits + 1, 0);
+        node_mask[props.numa_node / bits] |= 1ul << (props.numa_node % bits);
+        if (syscall(SYS_mbind, ptr, length, MPOL_BIND, node_mask.data(), node_mask.size() * bits + 1, 0) != 0)
+            debug("mbind() failed to bind % bytes to NUMA node %", length, props.numa_node);
+    }
+    #endif
+    if ((props.flags & AllocProps::Pinned) && mlock(ptr, length) != 0)
+        debug("mlock() failed to pin % bytes", length);
+}
+#endif
+
+CpuPlatform::MemoryFile::~MemoryFile() {
+#ifndef _WIN32
+    close(fd);
+#endif
+}
+
+#ifdef __linux__
+std::shared_ptr<CpuPlatform::MemoryFile> CpuPlatform::create_memory_file(size_t length) {
+    #ifdef SYS_memfd_create
+    int fd = syscall(SYS_memfd_create, "anydsl", MFD_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+    auto file = std::make_shared<MemoryFile>();
+    file->fd = fd;
+    if (ftruncate(fd, length) != 0)
+        return nullptr;
+    return file;
+    #else
+    unused(length);
+    return nullptr;
+    #endif
+}
+
+/// Writes memory to a file, retrying after partial writes.
+static bool write_file(int fd, const char* data, size_t offset, size_t size) {
+    while (size > 0) {
+        auto written = pwrite(fd, data, size, offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+}
+
+/// Writes the pages of a private file mapping that were copied on write back to the file.
+/// The modified pages are found with `/proc/self/pagemap`, or every page is written if it cannot be read.
+static bool write_modified_pages(int fd, const char* ptr, size_t length) {
+    int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (pagemap < 0)
+        return write_file(fd, ptr, 0, length);
+
+    // Modified pages are anonymous pages, either present or swapped out
+    const uint64_t present = uint64_t(1) << 63, swapped = uint64_t(1) << 62, file_page = uint64_t(1) << 61;
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t num_pages = (length + page_size - 1) / page_size;
+    const size_t chunk = 4096;
+    std::vector<uint64_t> entries(chunk);
+
+    bool ok = true;
+    size_t run_begin = 0, run_end = 0;
+    auto flush = [&] {
+        auto begin = run_begin * page_size, end = std::min(run_end * page_size, length);
+        if (end > begin)
+            ok &= write_file(fd, ptr + begin, begin, end - begin);
+    };
+    for (size_t first = 0; first < num_pages && ok; first += chunk) {
+        auto count = std::min(chunk, num_pages - first);
+        auto offset = (reinterpret_cast<uintptr_t>(ptr) / page_size + first) * sizeof(uint64_t);
+        if (pread(pagemap, entries.data(), count * sizeof(uint64_t), offset) != ssize_t(count * sizeof(uint64_t)))
+            std::fill(entries.begin(), entries.begin() + count, swapped);
+        for (size_t i = 0; i < count; ++i) {
+            bool modified = ((entries[i] & present) && !(entries[i] & file_page)) || (entries[i] & swapped);
+            if (!modified)
+                continue;
+            if (run_end != first + i) {
+                flush();
+                run_begin = first + i;
+            }
+            run_end = first + i + 1;
+        }
+    }
+    flush();
+    close(pagemap);
+    return ok;
+}
+
+bool CpuPlatform::freeze_mapping(char* ptr, FileMapping& mapping) {
+    if (mapping.is_private) {
+        if (mapping.file.use_count() > 1) {
+            // Snapshots map the current file, so the allocation moves to a new one
+            auto file = create_memory_file(mapping.length);
+            if (!file || !write_file(file->fd, ptr, 0, mapping.length))
+                return false;
+            mapping.file = file;
+        } else if (!write_modified_pages(mapping.file->fd, ptr, mapping.length)) {
+            return false;
+        }
+    }
+
+    // Remapping drops the pages copied on write, whose contents are now in the file
+    if (mmap(ptr, mapping.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, mapping.file->fd, 0) == MAP_FAILED)
+        error("mmap() failed to remap % bytes privately", mapping.length);
+    apply_page_props(ptr, mapping.length, mapping.props);
+    mapping.is_private = true;
+    return true;
+}
+#endif
+
+void* CpuPlatform::alloc_ex(DeviceId, int64_t size, const AllocProps& props) {
+    if (!size) return nullptr;
+
+    // Fresh pages are only worth a system call for placement requests or large zero-initialized blocks
+    const int64_t min_zero_map_size = int64_t(64) << 10;
+    bool use_pages = props.flags & (AllocProps::HugePages | AllocProps::Pinned | AllocProps::NumaNode | AllocProps::Snapshots);
+    use_pages |= (props.flags & AllocProps::ZeroInit) && size >= min_zero_map_size;
+#ifndef _WIN32
+    if (use_pages)
+        return map_pages(size, props);
+#else
+    unused(use_pages);
+#endif
+
+    auto ptr = Runtime::aligned_malloc(size, std::max(props.alignment, int64_t(32)));
+    if (props.flags & AllocProps::ZeroInit)
+        std::memset(ptr, 0, size);
+    return ptr;
+}
+
+#ifndef _WIN32
+/// Maps anonymous pages at an address with the given alignment, or returns `MAP_FAILED`.
+static char* map_aligned(size_t length, int64_t align, int prot, int flags) {
+    // Over-allocate and trim the mapping to obtain alignments larger than a page
+    size_t mapped = length + (align > PAGE_SIZE ? align : 0);
+    auto base = static_cast<char*>(mmap(nullptr, mapped, prot, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0));
+    if (base == MAP_FAILED)
+        return base;
+    auto ptr = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(base) + align - 1) & ~uintptr_t(align - 1));
+    if (ptr != base)
+        munmap(base, ptr - base);
+    if (base + mapped != ptr + length)
+        munmap(ptr + length, base + mapped - (ptr + length));
+    return ptr;
+}
+#endif
+
+void* CpuPlatform::map_pages(int64_t size, const AllocProps& props) {
+#ifndef _WIN32
+    const int64_t huge_page_size = int64_t(2) << 20;
+    int64_t align = std::max(props.alignment, int64_t(PAGE_SIZE));
+    if (props.flags & AllocProps::HugePages)
+        align = std::max(align, huge_page_size);
+    size_t length = (size + PAGE_SIZE - 1) & ~int64_t(PAGE_SIZE - 1);
+
+    auto ptr = map_aligned(length, align, PROT_READ | PROT_WRITE, 0);
+    if (ptr == MAP_FAILED)
+        error("mmap() failed to allocate % bytes", size);
+
+    #ifdef __linux__
+    if (props.flags & AllocProps::Snapshots) {
+        // The file replaces the anonymous pages, and snapshots map it privately
+        auto file = create_memory_file(length);
+        if (file && mmap(ptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, file->fd, 0) != MAP_FAILED) {
+            std::lock_guard<std::mutex> guard(mappings_lock_);
+            file_mappings_[ptr] = FileMapping { file, length, props, false };
+        } else {
+            debug("Cannot back % bytes by a memory file, snapshots will be copies", length);
+        }
+    }
+    #endif
+    apply_page_props(ptr, length, props);
+
+    std::lock_guard<std::mutex> guard(mappings_lock_);
+    mappings_[ptr] = Mapping { length, align };
+    return ptr;
+#else
+    unused(size, props);
+    return nullptr;
+#endif
+}
+
+void* CpuPlatform::snapshot(DeviceId dev, const void* ptr, int64_t size) {
+#ifdef __linux__
+    {
+        std::lock_guard<std::mutex> guard(mappings_lock_);
+        auto addr = static_cast<const char*>(ptr);
+        auto it = std::find_if(file_mappings_.begin(), file_mappings_.end(), [&] (const auto& entry) {
+            auto begin = static_cast<const char*>(entry.first);
+            return addr >= begin && addr + size <= begin + entry.second.length;
+        });
+        if (it != file_mappings_.end() && size > 0 && freeze_mapping(static_cast<char*>(it->first), it->second)) {
+            auto& mapping = it->second;
+            auto [begin, length] = page_range(const_cast<void*>(ptr), size);
+            auto offset = begin - static_cast<char*>(it->first);
+            auto base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, mapping.file->fd, offset);
+            if (base == MAP_FAILED)
+                error("mmap() failed to map a snapshot of % bytes", length);
+            auto snapshot = static_cast<char*>(base) + (addr - begin);
+            snapshots_[snapshot] = Snapshot { mapping.file, static_cast<char*>(base), length };
+            return snapshot;
+        }
+    }
+#endif
+    return Platform::snapshot(dev, ptr, size);
+}
+
+#ifndef _WIN32
+static size_t page_align(int64_t size) {
+    return (size + PAGE_SIZE - 1) & ~int64_t(PAGE_SIZE - 1);
+}
+
+/// Makes the pages of a reservation accessible up to `length` bytes.
+static void commit_pages(char* ptr, size_t& committed, size_t length) {
+    if (length <= committed)
+        return;
+    if (mprotect(ptr + committed, length - committed, PROT_READ | PROT_WRITE) != 0)
+        error("mprotect() failed to commit % bytes", length - committed);
+    committed = length;
+}
+
+/// Frees the pages of a reservation past `length` bytes.
+static void decommit_pages(char* ptr, size_t& committed, size_t length) {
+    if (length >= committed)
+        return;
+    // Mapping inaccessible pages over the range releases its memory
+    if (mmap(ptr + length, committed - length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+        error("mmap() failed to decommit % bytes", committed - length);
+    committed = length;
+}
+#endif
+
+void* CpuPlatform::alloc_shared(DeviceId, const char* name, int64_t size, int32_t flags) {
+#ifndef _WIN32
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        error("shm_open() failed to create shared memory '%': %", name, std::strerror(errno));
+    // The file keeps the exact size, which `open_shared()` reports, while the mapping covers whole pages
+    size_t length = page_align(size);
+    auto ptr = ftruncate(fd, size) == 0 ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        shm_unlink(name);
+        error("Cannot map % bytes of shared memory '%'", size, name);
+    }
+
+    AllocProps props {};
+    props.flags = flags & AllocProps::HugePages;
+    apply_page_props(static_cast<char*>(ptr), length, props);
+    std::lock_guard<std::mutex> guard(mappings_lock_);
+    mappings_[ptr] = Mapping { length, int64_t(PAGE_SIZE) };
+    shared_names_[ptr] = name;
+    return ptr;
+#else
+    unused(name, size, flags);
+    error("Shared memory is not supported on this system");
+    return nullptr;
+#endif
+}
+
+void* CpuPlatform::open_shared(DeviceId, const char* name, int64_t& size) {
+#ifndef _WIN32
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        error("shm_open() failed to open shared memory '%': %", name, std::strerror(errno));
+    struct stat stat;
+    auto ptr = fstat(fd, &stat) == 0 && stat.st_size > 0
+        ? mmap(nullptr, stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : MAP_FAILED;
+    close(fd);
+    if (ptr == MAP_FAILED)
+        error("Cannot map shared memory '%'", name);
+
+    size = stat.st_size;
+    std::lock_guard<std::mutex> guard(mappings_lock_);
+    mappings_[ptr] = Mapping { size_t(stat.st_size), int64_t(PAGE_SIZE) };
+    shared_names_[ptr] = std::string();
+    return ptr;
+#else
+    unused(name, size);
+    error("Shared memory is not supported on this system");
+    return nullptr;
+#endif
+}
+
+CpuPlatform::Reservation& CpuPlatform::find_reservation(void* ptr) {
+    auto it = reservations_.find(ptr);
+    if (it == reservations_.end())
+        error("Pointer % was not reserved with alloc_reserve() for the CPU", ptr);
+    return it->second;
+}
+
+void* CpuPlatform::alloc_reserve(DeviceId dev, int64_t max_size) {
+#ifndef _WIN32
+    unused(dev);
+    if (!max_size) return nullptr;
+
+    // Reserved pages are only backed by memory once they are committed
+    size_t capacity = page_align(max_size);
+    auto ptr = mmap(nullptr, capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED)
+        error("mmap() failed to reserve % bytes", max_size);
+    std::lock_guard<std::mutex> guard(mappings_lock_);
+    reservations_[ptr] = Reservation { capacity, 0 };
+    return ptr;
+#else
+    return Platform::alloc_reserve(dev, max_size);
+#endif
+}
+
+void CpuPlatform::commit(DeviceId, void* ptr, int64_t size) {
+#ifndef _WIN32
+    std::lock_guard<std::mutex> guard(mappings_lock_);
+    auto& reservation = find_reservation(ptr);
+    auto length = page_align(size);
+    if (length > reservation.capacity)
+        error("Cannot commit % bytes in a reservation of % bytes", size, reservation.capacity);
+    commit_pages(static_cast<char*>(ptr), reservation.committed, length);
+#else
+    unused(ptr, size);
+#endif
+}
+
+void CpuPlatform::decommit(DeviceId, void* ptr, int64_t size) {
+#ifndef _WIN32
+    std::lock_guard<std::mutex> guard(mappings_lock_);
+    auto& reservation = find_reservation(ptr);
+    wait_prefetch(ptr, reservation.capacity);
+    decommit_pages(static_cast<char*>(ptr), reservation.committed, page_align(size));
+#else
+    unused(ptr, size);
+#endif
+}
+
+void* CpuPlatform::realloc(DeviceId dev, void* ptr, int64_t old_size, int64_t new_size) {
+#ifndef _WIN32
+    std::unique_lock<std::mutex> guard(mappings_lock_);
+    auto length = page_align(new_size);
+    auto reservation = reservations_.find(ptr);
+    if (reservation != reservations_.end())
+        wait_prefetch(ptr, reservation->second.capacity);
+    if (reservation != reservations_.end() && length <= reservation->second.capacity) {
+        commit_pages(static_cast<char*>(ptr), reservation->second.committed, length);
+        decommit_pages(static_cast<char*>(ptr), reservation->second.committed, length);
+        return ptr;
+    }
+    #ifdef __linux__
+    if (reservation != reservations_.end() && length > 0) {
+        // The committed pages are moved by the kernel, without copying, and the rest of the reservation is given up
+        auto [capacity, committed] = reservation->second;
+        void* new_ptr = MAP_FAILED;
+        if (committed > 0) {
+            munmap(static_cast<char*>(ptr) + committed, capacity - committed);
+            new_ptr = mremap(ptr, committed, length, MREMAP_MAYMOVE);
+        } else {
+            munmap(ptr, capacity);
+            new_ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        if (new_ptr == MAP_FAILED)
+            error("Cannot grow a reservation of % bytes to % bytes", capacity, length);
+        reservations_.erase(reservation);
+        reservations_[new_ptr] = Reservation { length, length };
+        return new_ptr;
+    }
+    auto mapping = mappings_.find(ptr);
+    if (mapping != mappings_.end() && length > 0 && !file_mappings_.count(ptr) && !shared_names_.count(ptr)) {
+        auto [old_length, align] = mapping->second;
+        wait_prefetch(ptr, old_length);
+        void* new_ptr = MAP_FAILED;
+        if (align > PAGE_SIZE) {
+            // The kernel only keeps page alignment when it moves the pages, so they are moved over an aligned placeholder
+            auto target = map_aligned(length, align, PROT_NONE, MAP_NORESERVE);
+            if (target != MAP_FAILED) {
+                new_ptr = mremap(ptr, old_length, length, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+                if (new_ptr == MAP_FAILED)
+                    munmap(target, length);
+            }
+        } else {
+            new_ptr = mremap(ptr, old_length, length, MREMAP_MAYMOVE);
+        }
+        if (new_ptr == MAP_FAILED)
+            error("mremap() failed to resize % bytes to % bytes", old_length, length);
+        mappings_.erase(mapping);
+        mappings_[new_ptr] = Mapping { length, align };
+        return new_ptr;
+    }
+    #endif
+    guard.unlock();
+#endif
+    return Platform::realloc(dev, ptr, old_size, new_size);
+}
+
+void CpuPlatform::release(DeviceId, void* ptr) {
+#ifndef _WIN32
+    {
+        std::lock_guard<std::mutex> guard(mappings_lock_);
+        auto reservation = reservations_.find(ptr);
+        if (reservation != reservations_.end()) {
+            wait_prefetch(ptr, reservation->second.capacity);
+            munmap(ptr, reservation->second.capacity);
+            reservations_.erase(reservation);
+            return;
+        }
+        auto it = mappings_.find(ptr);
+        if (it != mappings_.end()) {
+            wait_prefetch(ptr, it->second.length);
+            munmap(ptr, it->second.length);
+            mappings_.erase(it);
+            file_mappings_.erase(ptr);
+            auto shared = shared_names_.find(ptr);
+            if (shared != shared_names_.end()) {
+                if (!shared->second.empty())
+                    shm_unlink(shared->second.c_str());
+                shared_names_.erase(shared);
+            }
+            return;
+        }
+        auto snapshot = snapshots_.find(ptr);
+        if (snapshot != snapshots_.end()) {
+            wait_prefetch(snapshot->second.base, snapshot->second.length);
+            munmap(snapshot->second.base, snapshot->second.length);
+            snapshots_.erase(snapshot);
+            return;
+        }
+    }
+#endif
+    // The size of heap allocations is unknown, but prefetches of a buffer start at or after its first byte
+    wait_prefetch(ptr, 1);
+    Runtime::aligned_free(ptr);
+}
+
+bool CpuPlatform::host_register(DeviceId, void* ptr, int64_t size, int32_t) {
+    // The memory is already accessible, locking it only keeps it resident
+#ifndef _WIN32
+    auto [begin, length] = page_range(ptr, size);
+    if (mlock(begin, length) != 0)
+        debug("mlock() failed to lock % bytes at %", size, ptr);
+#endif
+    std::lock_guard<std::mutex> guard(registered_lock_);
+    registered_[ptr] = size;
+    return true;
+}
+
+void CpuPlatform::host_unregister(DeviceId, void* ptr) {
+    std::lock_guard<std::mutex> guard(registered_lock_);
+    auto it = registered_.find(ptr);
+    if (it == registered_.end())
+        error("Pointer % was not registered with host_register() for the CPU", ptr);
+#ifndef _WIN32
+    auto [begin, length] = page_range(ptr, it->second);
+    munlock(begin, length);
+#endif
+    registered_.erase(it);
+}
+
+void CpuPlatform::mem_advise(DeviceId, void* ptr, int64_t size, MemAdvice advice) {
+#ifndef _WIN32
+    int posix_advice;
+    switch (advice) {
+        case MemAdvice::Sequential: posix_advice = POSIX_MADV_SEQUENTIAL; break;
+        case MemAdvice::Random:     posix_advice = POSIX_MADV_RANDOM;     break;
+        case MemAdvice::WillNeed:   posix_advice = POSIX_MADV_WILLNEED;   break;
+        case MemAdvice::DontNeed:   posix_advice = POSIX_MADV_DONTNEED;   break;
+        default:
+            // Placement hints are meaningless when the device is the host itself
+            return;
+    }
+    auto [begin, length] = page_range(ptr, size);
+    if (posix_madvise(begin, length, posix_advice) != 0)
+        debug("posix_madvise() failed for range % of % bytes", ptr, size);
+#else
+    unused(ptr, size, advice);
+#endif
+}
+
+void CpuPlatform::mem_prefetch(DeviceId dev, void* ptr, int64_t size) {
+    if (size <= 0)
+        return;
+    mem_advise(dev, ptr, size, MemAdvice::WillNeed);
+
+    std::call_once(prefetcher_started_, [this] {
+        prefetcher_.thread = std::thread([this] { run_prefetcher(); });
+    });
+    {
+        std::lock_guard<std::mutex> guard(prefetcher_.lock);
+        prefetcher_.ranges.emplace_back(static_cast<char*>(ptr), size);
+    }
+    prefetcher_.cond.notify_all();
+}
+
+void CpuPlatform::wait_prefetch(const void* ptr, int64_t size) {
+    auto begin = static_cast<const char*>(ptr);
+    auto end = begin + size;
+    auto overlaps = [&] (const std::pair<char*, int64_t>& range) { return range.first < end && begin < range.first + range.second; };
+
+    std::unique_lock<std::mutex> guard(prefetcher_.lock);
+    auto& ranges = prefetcher_.ranges;
+    ranges.erase(std::remove_if(ranges.begin(), ranges.end(), overlaps), ranges.end());
+    prefetcher_.cond.wait(guard, [&] { return !overlaps(prefetcher_.current); });
+}
+
+void CpuPlatform::run_prefetcher() {
+    auto& prefetcher = prefetcher_;
+    std::unique_lock<std::mutex> guard(prefetcher.lock);
+    while (true) {
+        prefetcher.cond.wait(guard, [&] { return prefetcher.stop || !prefetcher.ranges.empty(); });
+        if (prefetcher.stop)
+            return;
+        prefetcher.current = prefetcher.ranges.front();
+        prefetcher.ranges.pop_front();
+        auto [ptr, size] = prefetcher.current;
+        guard.unlock();
+
+        // Populating for reading keeps private mappings copy-on-write, and fails instead of faulting on inaccessible pages.
+        // Kernels without it only get the `MADV_WILLNEED` hint given by `mem_prefetch()`.
+        #ifdef __linux__
+        auto [begin, length] = page_range(ptr, size);
+        if (madvise(begin, length, MADV_POPULATE_READ) != 0)
+            debug("madvise(MADV_POPULATE_READ) failed for range % of % bytes", (void*)ptr, size);
+        #else
+        unused(ptr, size);
+        #endif
+
+        guard.lock();
+        prefetcher.current = { nullptr, 0 };
+        prefetcher.cond.notify_all();
+    }
+}
+
+void* CpuPlatform::stream_create(DeviceId) {
+    auto stream = new Stream;
+    stream->thread = std::thread([this, stream] { run_stream(*stream); });
+    return stream;
+}
+
+void CpuPlatform::stream_destroy(DeviceId, void* ptr) {
+    auto stream = static_cast<Stream*>(ptr);
+    {
+        std::lock_guard<std::mutex> guard(stream->lock);
+        stream->stop = true;
+    }
+    stream->cond.notify_all();
+    // The worker runs the remaining tasks before it stops
+    stream->thread.join();
+    delete stream;
+}
+
+void CpuPlatform::stream_synchronize(DeviceId, void* ptr) {
+    auto stream = static_cast<Stream*>(ptr);
+    std::unique_lock<std::mutex> guard(stream->lock);
+    stream->cond.wait(guard, [&] { return stream->tasks.empty() && !stream->busy; });
+}
+
+void CpuPlatform::copy_async(DeviceId, void* stream, CopyKind, const CopyRegion& region) {
+    enqueue(*static_cast<Stream*>(stream), [this, region] {
+        copy(region.src, region.offset_src, region.dst, region.offset_dst, region.size);
+    });
+}
+
+CpuPlatform::Event* CpuPlatform::retain_event(Event* event) {
+    event->refs.fetch_add(1, std::memory_order_relaxed);
+    return event;
+}
+
+void CpuPlatform::release_event(Event* event) {
+    if (event->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete event;
+}
+
+void CpuPlatform::event_destroy(DeviceId, void* event) {
+    // Pending markers and waits keep the event alive until they have run
+    release_event(static_cast<Event*>(event));
+}
+
+void CpuPlatform::complete(Event& event, uint64_t recording) {
+    std::lock_guard<std::mutex> guard(event.lock);
+    if (recording > event.completed) {
+        event.completed = recording;
+        event.time = host_time();
+    }
+    event.cond.notify_all();
+}
+
+void CpuPlatform::event_record(DeviceId, void* stream, void* ptr) {
+    auto event = static_cast<Event*>(ptr);
+    uint64_t recording;
+    {
+        std::lock_guard<std::mutex> guard(event->lock);
+        recording = ++event->recorded;
+    }
+    // Without a stream, all the commands have already completed
+    if (!stream)
+        return complete(*event, recording);
+    enqueue(*static_cast<Stream*>(stream), [event = retain_event(event), recording] {
+        complete(*event, recording);
+        release_event(event);
+    });
+}
+
+void CpuPlatform::event_wait(DeviceId dev, void* stream, void* ptr) {
+    if (!stream)
+        return event_synchronize(dev, ptr);
+    auto event = static_cast<Event*>(ptr);
+    uint64_t recording;
+    {
+        std::lock_guard<std::mutex> guard(event->lock);
+        recording = event->recorded;
+    }
+    // Only the worker of the stream blocks on the event
+    enqueue(*static_cast<Stream*>(stream), [event = retain_event(event), recording] {
+        {
+            std::unique_lock<std::mutex> guard(event->lock);
+            event->cond.wait(guard, [&] { return event->completed >= recording; });
+        }
+        release_event(event);
+    });
+}
+
+bool CpuPlatform::event_query(DeviceId, void* ptr) {
+    auto event = static_cast<Event*>(ptr);
+    std::lock_guard<std::mutex> guard(event->lock);
+    return event->completed == event->recorded;
+}
+
+void CpuPlatform::event_synchronize(DeviceId, void* ptr) {
+    auto event = static_cast<Event*>(ptr);
+    std::unique_lock<std::mutex> guard(event->lock);
+    event->cond.wait(guard, [&] { return event->completed == event->recorded; });
+}
+
+int64_t CpuPlatform::event_elapsed(DeviceId dev, void* start, void* end) {
+    event_synchronize(dev, start);
+    event_synchronize(dev, end);
+    return static_cast<Event*>(end)->time - static_cast<Event*>(start)->time;
+}
+
+void CpuPlatform::enqueue(Stream& stream, std::function<void()>&& task) {
+    {
+        std::lock_guard<std::mutex> guard(stream.lock);
+        stream.tasks.emplace_back(std::move(task));
+    }
+    stream.cond.notify_all();
+}
+
+void CpuPlatform::run_stream(Stream& stream) {
+    std::unique_lock<std::mutex> guard(stream.lock);
+    while (true) {
+        stream.cond.wait(guard, [&] { return stream.stop || !stream.tasks.empty(); });
+        if (stream.tasks.empty())
+            return;
+        auto task = std::move(stream.tasks.front());
+        stream.tasks.pop_front();
+        stream.busy = true;
+        guard.unlock();
+
+        task();
+
+        guard.lock();
+        stream.busy = false;
+        stream.cond.notify_all();
+    }
+}
+
+/// Persistent workers for parallel copies, fills, and conversions. Dispatching them only wakes threads up, whereas
+/// `anydsl_parallel_for()` creates threads on every call when the runtime is built without TBB.
+class CopyWorkers {
+public:
+    CopyWorkers(int32_t num_workers) {
+        for (int32_t i = 0; i < num_workers; ++i)
+            std::thread([this] { work(); }).detach();
+        num_workers_ = num_workers;
+    }
+
+    /// Runs `fun(args, i)` for every `i` in `[0, num_tasks)`, with the calling thread taking part.
+    /// Tasks run on the calling thread alone while the workers are busy with another call.
+    void run(int32_t num_tasks, void (*fun)(const void*, int32_t), const void* args) {
+        std::unique_lock<std::mutex> busy(run_lock_, std::try_to_lock);
+        if (!busy || num_workers_ == 0) {
+            for (int32_t i = 0; i < num_tasks; ++i)
+                fun(args, i);
+            return;
+        }
+
+        Job job;
+        job.fun = fun;
+        job.args = args;
+        job.num_tasks = num_tasks;
+
+        std::unique_lock<std::mutex> guard(lock_);
+        job_ = &job;
+        generation_++;
+        guard.unlock();
+        wake_.notify_all();
+
+        int32_t done = execute(job);
+
+        // The job lives on this stack frame, and must not be used by any worker once this call returns
+        guard.lock();
+        job.done += done;
+        job_ = nullptr;
+        done_.wait(guard, [&] { return job.done == num_tasks && job.workers == 0; });
+    }
+
+private:
+    struct Job {
+        void (*fun)(const void*, int32_t);
+        const void* args;
+        int32_t num_tasks;
+        std::atomic<int32_t> next { 0 };
+        /// Number of completed tasks and of workers executing tasks, guarded by `lock_`.
+        int32_t done = 0;
+        int32_t workers = 0;
+    };
+
+    /// Executes tasks of the job until none is left, and returns how many were executed.
+    static int32_t execute(Job& job) {
+        int32_t done = 0;
+        for (int32_t i; (i = job.next.fetch_add(1, std::memory_order_relaxed)) < job.num_tasks; ++done)
+            job.fun(job.args, i);
+        return done;
+    }
+
+    void work() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> guard(lock_);
+        while (true) {
+            wake_.wait(guard, [&] { return generation_ != seen; });
+            seen = generation_;
+            auto job = job_;
+            if (!job)
+                continue;
+
+            job->workers++;
+            guard.unlock();
+            int32_t done = execute(*job);
+            guard.lock();
+            job->done += done;
+            job->workers--;
+            done_.notify_all();
+        }
+    }
+
+    int32_t num_workers_;
+    std::mutex run_lock_;
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    Job* job_ = nullptr;
+    uint64_t generation_ = 0;
+};
+
+void parallel_tasks(int32_t num_tasks, void (*fun)(const void*, int32_t), const void* args) {
+    if (num_tasks <= 1) {
+        if (num_tasks == 1) fun(args, 0);
+        return;
+    }
+    // The calling thread takes part, so one worker less than the hardware threads is enough.
+    // The workers are never destroyed, as joining threads while static objects are destroyed at exit may deadlock.
+    static auto workers = new CopyWorkers(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    workers->run(num_tasks, fun, args);
+}
+
+/// Copies memory without polluting the caches, using non-temporal stores when available.
+static void stream_copy(char* dst, const char* src, size_t size) {
+#ifdef CPU_PLATFORM_HAS_STREAMING_STORES
+    size_t head = std::min(size, (16 - reinterpret_cast<uintptr_t>(dst) % 16) % 16);
+    memcpy(dst, src, head);
+    dst += head; src += head; size -= head;
+
+    size_t body = size & ~size_t(63);
+    for (size_t i = 0; i < body; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i +  0));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i +  0), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 48), d);
+    }
+    _mm_sfence();
+    memcpy(dst + body, src + body, size - body);
+#else
+    memcpy(dst, src, size);
+#endif
+}
+
+/// Splits a large copy into cache-line aligned chunks, one per worker.
+static void parallel_stream_copy(char* dst, const char* src, int64_t size, int32_t num_threads) {
+    int64_t chunk = ((size + num_threads - 1) / num_threads + 63) & ~int64_t(63);
+    parallel_tasks(num_threads, [=] (int32_t i) {
+        int64_t begin = std::min(size, i * chunk);
+        int64_t end   = std::min(size, begin + chunk);
+        stream_copy(dst + begin, src + begin, end - begin);
+    });
+}
+
+void CpuPlatform::copy_batch(CopyKind, DeviceId, DeviceId, const CopyRegion* regions, size_t count) {
+    // Large regions are split over the workers on their own
+    int64_t total = 0;
+    std::vector<CopyRegion> small;
+    for (size_t i = 0; i < count; ++i) {
+        auto& region = regions[i];
+        if (region.size >= min_copy_threshold && region.size >= copy_tuning().threshold) {
+            copy(region.src, region.offset_src, region.dst, region.offset_dst, region.size);
+        } else {
+            small.push_back(region);
+            total += region.size;
+        }
+    }
+
+    auto copy_regions = [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            memcpy(static_cast<char*>(small[i].dst) + small[i].offset_dst, static_cast<const char*>(small[i].src) + small[i].offset_src, small[i].size);
+    };
+    int32_t num_threads = copy_tuning().num_threads;
+    if (total < min_copy_threshold || total < copy_tuning().threshold || num_threads <= 1)
+        return copy_regions(0, small.size());
+
+    // Each worker copies a contiguous range of regions holding roughly the same number of bytes
+    std::vector<size_t> bounds(num_threads + 1, small.size());
+    bounds[0] = 0;
+    int64_t copied = 0;
+    for (size_t i = 0, worker = 1; i < small.size() && worker < size_t(num_threads); ++i) {
+        copied += small[i].size;
+        while (worker < size_t(num_threads) && copied * num_threads >= total * int64_t(worker))
+            bounds[worker++] = i + 1;
+    }
+    parallel_tasks(num_threads, [&] (int32_t i) { copy_regions(bounds[i], bounds[i + 1]); });
+}
+
+void CpuPlatform::copy_3d(CopyKind, DeviceId, const void* src, Pitch src_pitch, DeviceId, void* dst, Pitch dst_pitch, const Region3D& region) {
+    auto src_ptr = static_cast<const char*>(src) + region.src_z * src_pitch.slice + region.src_y * src_pitch.row + region.src_x;
+    auto dst_ptr = static_cast<char*>(dst) + region.dst_z * dst_pitch.slice + region.dst_y * dst_pitch.row + region.dst_x;
+    int64_t num_rows = region.height * region.depth;
+    auto copy_rows = [&] (int64_t begin, int64_t end) {
+        for (int64_t row = begin; row < end; ++row) {
+            int64_t y = row % region.height, z = row / region.height;
+            memcpy(dst_ptr + z * dst_pitch.slice + y * dst_pitch.row, src_ptr + z * src_pitch.slice + y * src_pitch.row, region.width);
+        }
+    };
+
+    int64_t total = region.width * num_rows;
+    int32_t num_threads = copy_tuning().num_threads;
+    if (total < min_copy_threshold || total < copy_tuning().threshold || num_threads <= 1 || num_rows < num_threads)
+        return copy_rows(0, num_rows);
+
+    int64_t rows_per_thread = (num_rows + num_threads - 1) / num_threads;
+    parallel_tasks(num_threads, [&] (int32_t i) {
+        copy_rows(std::min(num_rows, i * rows_per_thread), std::min(num_rows, (i + 1) * rows_per_thread));
+    });
+}
+
+// Fills operate on lines of this size, which holds a whole number of patterns
+static constexpr size_t fill_line_size = 128;
+
+/// Fills memory by repeating the given line, using non-temporal stores when available.
+static void stream_fill(char* dst, const char* line, size_t size) {
+#ifdef CPU_PLATFORM_HAS_STREAMING_STORES
+    size_t head = std::min(size, (16 - reinterpret_cast<uintptr_t>(dst) % 16) % 16);
+    memcpy(dst, line, head);
+    dst += head; size -= head;
+
+    // Rotate the line so that it starts at the phase reached after the unaligned head
+    alignas(16) char rotated[fill_line_size];
+    for (size_t i = 0; i < fill_line_size; ++i)
+        rotated[i] = line[(head + i) % fill_line_size];
+    __m128i values[fill_line_size / 16];
+    for (size_t i = 0; i < fill_line_size / 16; ++i)
+        values[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(rotated + i * 16));
+
+    size_t body = size & ~(fill_line_size - 1);
+    for (size_t i = 0; i < body; i += fill_line_size) {
+        for (size_t j = 0; j < fill_line_size / 16; ++j)
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + j * 16), values[j]);
+    }
+    _mm_sfence();
+    memcpy(dst + body, rotated, size - body);
+#else
+    for (size_t i = 0; i < size; i += fill_line_size)
+        memcpy(dst + i, line, std::min(fill_line_size, size - i));
+#endif
+}
+
+void CpuPlatform::memset(DeviceId, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) {
+    auto dst = static_cast<char*>(ptr) + offset;
+    if (pattern_size == 1 && (size < min_copy_threshold || size < copy_tuning().threshold)) {
+        std::memset(dst, *static_cast<const unsigned char*>(pattern), size);
+        return;
+    }
+
+    char line[fill_line_size];
+    for (size_t i = 0; i < fill_line_size; i += pattern_size)
+        memcpy(line + i, pattern, pattern_size);
+
+    if (size < min_copy_threshold || size < copy_tuning().threshold) {
+        // Doubling the filled prefix lets `memcpy()` do the work in a logarithmic number of calls
+        int64_t filled = std::min(size, int64_t(fill_line_size));
+        memcpy(dst, line, filled);
+        for (; filled < size; filled *= 2)
+            memcpy(dst + filled, dst, std::min(filled, size - filled));
+        return;
+    }
+
+    // Chunks start on a line boundary so that every worker begins at the same phase of the pattern
+    int32_t num_threads = copy_tuning().num_threads;
+    int64_t chunk = ((size + num_threads - 1) / num_threads + fill_line_size - 1) & ~int64_t(fill_line_size - 1);
+    parallel_tasks(num_threads, [=, &line] (int32_t i) {
+        int64_t begin = std::min(size, i * chunk);
+        int64_t end   = std::min(size, begin + chunk);
+        stream_fill(dst + begin, line, end - begin);
+    });
+}
+
+CpuPlatform::CopyTuning CpuPlatform::calibrate_copy() {
+    using namespace std::chrono;
+    // The probe must be larger than the last-level cache to measure memory bandwidth
+    const int64_t probe_size = int64_t(32) << 20;
+
+    auto src = static_cast<char*>(Runtime::aligned_malloc(probe_size, PAGE_SIZE));
+    auto dst = static_cast<char*>(Runtime::aligned_malloc(probe_size, PAGE_SIZE));
+    std::memset(src, 1, probe_size);
+    std::memset(dst, 0, probe_size);
+
+    // Returns the best time (in ns) out of a few runs, to filter out noise
+    auto measure = [&] (auto fn) {
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < 3; ++run) {
+            auto start = steady_clock::now();
+            fn();
+            best = std::min(best, double(duration_cast<nanoseconds>(steady_clock::now() - start).count()));
+        }
+        return std::max(best, 1.0);
+    };
+
+    double single_time = measure([&] { memcpy(dst, src, probe_size); });
+    double best_time = single_time;
+    int32_t best_threads = 1;
+
+    // Stop adding threads once the memory channels are saturated
+    int32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int32_t num_threads = 2; num_threads <= max_threads; num_threads *= 2) {
+        double time = measure([&] { parallel_stream_copy(dst, src, probe_size, num_threads); });
+        if (time > best_time * 0.9)
+            break;
+        best_time = time;
+        best_threads = num_threads;
+    }
+
+    // Parallel copies pay off when the bandwidth gain outweighs the cost of dispatching the workers
+    int64_t threshold = probe_size / 4;
+    if (best_threads > 1) {
+        double dispatch_time = measure([&] { parallel_tasks(best_threads, [] (int32_t) {}); });
+        double saved_per_byte = (single_time - best_time) / probe_size;
+        threshold = std::max(min_copy_threshold, int64_t(dispatch_time / saved_per_byte));
+    }
+
+    Runtime::aligned_free(src);
+    Runtime::aligned_free(dst);
+
+    debug("CPU copies above % bytes use % thread(s) (% GB/s, single-threaded % GB/s)",
+        threshold, best_threads, probe_size / best_time, probe_size / single_time);
+    return CopyTuning { threshold, best_threads };
+}
+
+const CpuPlatform::CopyTuning& CpuPlatform::copy_tuning() {
+    static CopyTuning tuning;
+    static std::once_flag calibrated;
+    std::call_once(calibrated, [] { tuning = calibrate_copy(); });
+    return tuning;
+}
+
+void CpuPlatform::copy(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) {
+    auto src_ptr = static_cast<const char*>(src) + offset_src;
+    auto dst_ptr = static_cast<char*>(dst) + offset_dst;
+
+    // Small copies never trigger the calibration
+    if (size < min_copy_threshold || size < copy_tuning().threshold) {
+        memcpy(dst_ptr, src_ptr, size);
+        return;
+    }
+
+    parallel_stream_copy(dst_ptr, src_ptr, size, copy_tuning().num_threads);
+}
@@ -7,18 +7,29 @@
 #define PAGE_SIZE 4096
 #endif
 
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 /// CPU platform, allocation is guaranteed to be aligned to page size: 4096 bytes.
 class CpuPlatform : public Platform {
 public:
     CpuPlatform(Runtime* runtime);
+    ~CpuPlatform();
 
 protected:
     void* alloc(DeviceId, int64_t size) override {
         return Runtime::aligned_malloc(size, 32);
     }
 
+    void* alloc_ex(DeviceId, int64_t size, const AllocProps& props) override;
+
     void* alloc_host(DeviceId, int64_t size) override {
         return Runtime::aligned_malloc(size, PAGE_SIZE);
     }
@@ -31,14 +42,108 @@ protected:
         return ptr;
     }
 
-    void release(DeviceId, void* ptr) override {
-        Runtime::aligned_free(ptr);
-    }
+    void release(DeviceId, void* ptr) override;
+    // There is no device work to wait for
+    void release_deferred(DeviceId dev, void* ptr) override { release(dev, ptr); }
+
+    bool host_register(DeviceId, void* ptr, int64_t size, int32_t flags) override;
+    void host_unregister(DeviceId, void* ptr) override;
+
+    /// Sizes of the ranges locked by `host_register()`.
+    std::mutex registered_lock_;
+    std::unordered_map<void*, int64_t> registered_;
 
     void release_host(DeviceId dev, void* ptr) override {
         release(dev, ptr);
     }
 
+    /// Allocates fresh pages from the OS, which are zero-initialized lazily.
+    void* map_pages(int64_t size, const AllocProps& props);
+
+    /// Allocations returned by `map_pages()`, with their mapped size and the alignment to keep when they are resized.
+    struct Mapping {
+        size_t length;
+        int64_t align;
+    };
+
+    std::mutex mappings_lock_;
+    std::unordered_map<void*, Mapping> mappings_;
+
+    void* alloc_shared(DeviceId, const char* name, int64_t size, int32_t flags) override;
+    void* open_shared(DeviceId, const char* name, int64_t& size) override;
+
+    /// Names of the shared memory objects created by `alloc_shared()`, which are removed on release.
+    /// Objects mapped by `open_shared()` have an empty name, as they belong to another process.
+    std::unordered_map<void*, std::string> shared_names_;
+
+    void* alloc_reserve(DeviceId dev, int64_t max_size) override;
+    void commit(DeviceId dev, void* ptr, int64_t size) override;
+    void decommit(DeviceId dev, void* ptr, int64_t size) override;
+    void* realloc(DeviceId dev, void* ptr, int64_t old_size, int64_t new_size) override;
+
+    /// Address space reserved by `alloc_reserve()`, of which the first `committed` bytes are accessible.
+    struct Reservation {
+        size_t capacity;
+        size_t committed;
+    };
+
+    Reservation& find_reservation(void* ptr);
+    std::unordered_map<void*, Reservation> reservations_;
+
+    void* snapshot(DeviceId dev, const void* ptr, int64_t size) override;
+
+    /// A memory file, closed once no allocation or snapshot maps it.
+    struct MemoryFile {
+        int fd;
+        ~MemoryFile();
+    };
+
+    /// An allocation made with `AllocProps::Snapshots`, which maps a memory file.
+    /// Once snapshotted, the allocation maps the file privately, and the pages it modifies are no longer in the file.
+    struct FileMapping {
+        std::shared_ptr<MemoryFile> file;
+        size_t length;
+        AllocProps props;
+        bool is_private;
+    };
+
+    /// A private mapping of a memory file returned by `snapshot()`.
+    struct Snapshot {
+        std::shared_ptr<MemoryFile> file;
+        char* base;
+        size_t length;
+    };
+
+    /// Creates an anonymous memory file of the given size, or returns `nullptr` if the system does not support it.
+    static std::shared_ptr<MemoryFile> create_memory_file(size_t length);
+    /// Updates the memory file with the contents of the allocation, and maps the allocation privately.
+    bool freeze_mapping(char* ptr, FileMapping& mapping);
+
+    std::unordered_map<void*, FileMapping> file_mappings_;
+    std::unordered_map<void*, Snapshot> snapshots_;
+
+    void mem_advise(DeviceId, void* ptr, int64_t size, MemAdvice advice) override;
+    void mem_prefetch(DeviceId, void* ptr, int64_t size) override;
+
+    /// Background thread that faults in the memory ranges passed to `mem_prefetch()`.
+    struct Prefetcher {
+        std::mutex lock;
+        std::condition_variable cond;
+        std::deque<std::pair<char*, int64_t>> ranges;
+        /// The range being populated, or an empty range.
+        std::pair<char*, int64_t> current { nullptr, 0 };
+        bool stop = false;
+        std::thread thread;
+    };
+
+    /// Drops the pending prefetches that overlap the given range, and waits for the current one if it overlaps,
+    /// so that the range can be unmapped or moved.
+    void wait_prefetch(const void* ptr, int64_t size);
+    void run_prefetcher();
+
+    std::once_flag prefetcher_started_;
+    Prefetcher prefetcher_;
+
     void no_kernel() {
         error("Kernels are not supported on the CPU");
     }
@@ -46,9 +151,50 @@ protected:
     void launch_kernel(DeviceId, const LaunchParams&) override { no_kernel(); }
     void synchronize(DeviceId) override { no_kernel(); }
 
-    void copy(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) {
-        memcpy((char*)dst + offset_dst, (char*)src + offset_src, size);
-    }
+    /// A stream on the CPU, whose commands run in order on a worker thread.
+    struct Stream {
+        std::mutex lock;
+        std::condition_variable cond;
+        std::deque<std::function<void()>> tasks;
+        bool busy = false;
+        bool stop = false;
+        std::thread thread;
+    };
+
+    void* stream_create(DeviceId) override;
+    void stream_destroy(DeviceId, void* stream) override;
+    void stream_synchronize(DeviceId, void* stream) override;
+    void copy_async(DeviceId, void* stream, CopyKind, const CopyRegion& region) override;
+    void launch_kernel_on(DeviceId, void*, const LaunchParams&) override { no_kernel(); }
+    void run_stream(Stream& stream);
+    void enqueue(Stream& stream, std::function<void()>&& task);
+
+    /// An event on the CPU, which counts its recordings and the ones that its streams have reached.
+    /// The event is complete when both counts are equal, and stores the time at which the last recording was reached.
+    struct Event {
+        std::mutex lock;
+        std::condition_variable cond;
+        uint64_t recorded = 0;
+        uint64_t completed = 0;
+        int64_t time = 0;
+        /// References of the handle and of the stream tasks that use the event, the last of which deletes it.
+        std::atomic<int32_t> refs { 1 };
+    };
+
+    static Event* retain_event(Event* event);
+    static void release_event(Event* event);
+
+    void* event_create(DeviceId) override { return new Event; }
+    void event_destroy(DeviceId, void* event) override;
+    void event_record(DeviceId, void* stream, void* event) override;
+    void event_wait(DeviceId dev, void* stream, void* event) override;
+    bool event_query(DeviceId, void* event) override;
+    void event_synchronize(DeviceId, void* event) override;
+    int64_t event_elapsed(DeviceId dev, void* start, void* end) override;
+    /// Marks the given recording of the event as reached.
+    static void complete(Event& event, uint64_t recording);
+
+    void copy(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size);
 
     void copy(DeviceId, const void* src, int64_t offset_src,
               DeviceId, void* dst, int64_t offset_dst, int64_t size) override {
@@ -63,6 +209,25 @@ protected:
         copy(src, offset_src, dst, offset_dst, size);
     }
 
+    void* alloc_pitched(DeviceId, int64_t width, int64_t height, int64_t depth, int64_t& pitch) override {
+        // Rows start on a cache line, which is enough for aligned vector loads
+        pitch = (width + 63) & ~int64_t(63);
+        return Runtime::aligned_malloc(pitch * height * depth, 64);
+    }
+    void copy_3d(CopyKind, DeviceId, const void* src, Pitch src_pitch, DeviceId, void* dst, Pitch dst_pitch, const Region3D& region) override;
+    void copy_batch(CopyKind, DeviceId, DeviceId, const CopyRegion* regions, size_t count) override;
+    void memset(DeviceId, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) override;
+
+    /// Copies and fills above `threshold` bytes are split over `num_threads` workers and use non-temporal stores.
+    struct CopyTuning {
+        int64_t threshold;
+        int32_t num_threads;
+    };
+
+    /// Returns the copy parameters, calibrated once per process with a short bandwidth probe.
+    static const CopyTuning& copy_tuning();
+    static CopyTuning calibrate_copy();
+
     std::string device_name_;
     size_t dev_count() const override { return 1; }
     std::string name() const override { return "CPU"; }
@@ -70,4 +235,13 @@ protected:
     bool device_check_feature_support(DeviceId, const char*) const override { return false; }
 };
 
+/// Runs `fun(args, i)` for every `i` in `[0, num_tasks)` on persistent host worker threads, with the calling thread taking part.
+void parallel_tasks(int32_t num_tasks, void (*fun)(const void*, int32_t), const void* args);
+
+/// Runs `body(i)` for every `i` in `[0, num_tasks)` on the persistent host worker threads.
+template <typename F>
+void parallel_tasks(int32_t num_tasks, const F& body) {
+    parallel_tasks(num_tasks, [] (const void* args, int32_t i) { (*static_cast<const F*>(args))(i); }, &body);
+}
+
 #endif
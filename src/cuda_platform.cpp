@@ -168,11 +168,15 @@ void CudaPlatform::erase_profiles(bool erase_all) {
 
 CudaPlatform::~CudaPlatform() {
     erase_profiles(true);
-    for (size_t i = 0; i < devices_.size(); i++)
+    for (size_t i = 0; i < devices_.size(); i++) {
+        // Frees the deferred allocations once their work is done, before the context that owns them is released
+        synchronize(i);
         cuDevicePrimaryCtxRelease(devices_[i].dev);
+    }
 }
 
 void* CudaPlatform::alloc(DeviceId dev, int64_t size) {
+    reclaim_deferred(dev, false);
     cuCtxPushCurrent(devices_[dev].ctx);
 
     CUdeviceptr mem;
@@ -183,6 +187,44 @@ void* CudaPlatform::alloc(DeviceId dev, int64_t size) {
     return (void*)mem;
 }
 
+void* CudaPlatform::try_alloc(DeviceId dev, int64_t size) {
+    // Memory that is still in use cannot be reclaimed to satisfy the allocation
+    reclaim_deferred(dev, false);
+    cuCtxPushCurrent(devices_[dev].ctx);
+
+    CUdeviceptr mem = 0;
+    CUresult err = cuMemAlloc(&mem, size);
+    if (err != CUDA_ERROR_OUT_OF_MEMORY)
+        CHECK_CUDA(err, "cuMemAlloc()");
+
+    cuCtxPopCurrent(NULL);
+    return err == CUDA_SUCCESS ? (void*)mem : nullptr;
+}
+
+void* CudaPlatform::alloc_ex(DeviceId dev, int64_t size, const AllocProps& props) {
+    // allocations are aligned to at least 256 bytes by the driver
+    const int64_t driver_alignment = 256;
+    void* mem;
+    if (props.alignment > driver_alignment) {
+        auto base = (CUdeviceptr)alloc(dev, size + props.alignment - driver_alignment);
+        auto aligned = (base + props.alignment - 1) & ~CUdeviceptr(props.alignment - 1);
+        if (aligned != base) {
+            auto& cuda_dev = devices_[dev];
+            cuda_dev.lock();
+            cuda_dev.aligned.emplace(aligned, base);
+            cuda_dev.unlock();
+        }
+        mem = (void*)aligned;
+    } else {
+        mem = alloc(dev, size);
+    }
+    if (props.flags & AllocProps::ZeroInit) {
+        const uint8_t zero = 0;
+        memset(dev, mem, 0, &zero, sizeof(zero), size);
+    }
+    return mem;
+}
+
 void* CudaPlatform::alloc_host(DeviceId dev, int64_t size) {
     cuCtxPushCurrent(devices_[dev].ctx);
 
@@ -216,13 +258,75 @@ void* CudaPlatform::get_device_ptr(DeviceId dev, void* ptr) {
     return (void*)mem;
 }
 
+CUdeviceptr CudaPlatform::allocation_base(DeviceId dev, void* ptr) {
+    auto& cuda_dev = devices_[dev];
+    auto mem = (CUdeviceptr)ptr;
+    cuda_dev.lock();
+    auto it = cuda_dev.aligned.find(mem);
+    if (it != cuda_dev.aligned.end()) {
+        mem = it->second;
+        cuda_dev.aligned.erase(it);
+    }
+    cuda_dev.unlock();
+    return mem;
+}
+
 void CudaPlatform::release(DeviceId dev, void* ptr) {
+    auto mem = allocation_base(dev, ptr);
     cuCtxPushCurrent(devices_[dev].ctx);
-    CUresult err = cuMemFree((CUdeviceptr)ptr);
+    CUresult err = cuMemFree(mem);
     CHECK_CUDA(err, "cuMemFree()");
     cuCtxPopCurrent(NULL);
 }
 
+void CudaPlatform::release_deferred(DeviceId dev, void* ptr) {
+    auto& cuda_dev = devices_[dev];
+    auto mem = allocation_base(dev, ptr);
+    cuCtxPushCurrent(cuda_dev.ctx);
+
+    // The legacy stream waits for the work of every thread's default stream
+    CUevent event;
+    CUresult err = cuEventCreate(&event, CU_EVENT_DISABLE_TIMING);
+    CHECK_CUDA(err, "cuEventCreate()");
+    err = cuEventRecord(event, CU_STREAM_LEGACY);
+    CHECK_CUDA(err, "cuEventRecord()");
+
+    cuCtxPopCurrent(NULL);
+
+    cuda_dev.lock();
+    cuda_dev.deferred.emplace_back(event, mem);
+    cuda_dev.unlock();
+
+    reclaim_deferred(dev, false);
+}
+
+void CudaPlatform::reclaim_deferred(DeviceId dev, bool synchronized) {
+    auto& cuda_dev = devices_[dev];
+    std::vector<std::pair<CUevent, CUdeviceptr>> completed;
+
+    cuda_dev.lock();
+    auto& deferred = cuda_dev.deferred;
+    if (deferred.empty()) {
+        cuda_dev.unlock();
+        return;
+    }
+    // Events on the legacy stream complete in order
+    auto end = synchronized ? deferred.end() : std::find_if(deferred.begin(), deferred.end(), [] (const auto& entry) {
+        return cuEventQuery(entry.first) != CUDA_SUCCESS;
+    });
+    completed.assign(deferred.begin(), end);
+    deferred.erase(deferred.begin(), end);
+    cuda_dev.unlock();
+
+    cuCtxPushCurrent(cuda_dev.ctx);
+    for (auto& [event, mem] : completed) {
+        CUresult err = cuMemFree(mem);
+        CHECK_CUDA(err, "cuMemFree()");
+        cuEventDestroy(event);
+    }
+    cuCtxPopCurrent(NULL);
+}
+
 void CudaPlatform::release_host(DeviceId dev, void* ptr) {
     cuCtxPushCurrent(devices_[dev].ctx);
     CUresult err = cuMemFreeHost(ptr);
@@ -230,11 +334,102 @@ void CudaPlatform::release_host(DeviceId dev, void* ptr) {
     cuCtxPopCurrent(NULL);
 }
 
+bool CudaPlatform::host_register(DeviceId dev, void* ptr, int64_t size, int32_t flags) {
+    cuCtxPushCurrent(devices_[dev].ctx);
+
+    unsigned int register_flags = CU_MEMHOSTREGISTER_DEVICEMAP;
+    #if CUDA_VERSION >= 11010
+    if (flags & HostRegisterReadOnly)
+        register_flags |= CU_MEMHOSTREGISTER_READ_ONLY;
+    #else
+    unused(flags);
+    #endif
+    CUresult err = cuMemHostRegister(ptr, size, register_flags);
+    if (err != CUDA_SUCCESS) {
+        const char* error_name;
+        cuGetErrorName(err, &error_name);
+        debug("cuMemHostRegister() failed for CUDA device %: %", dev, error_name);
+    }
+
+    cuCtxPopCurrent(NULL);
+    return err == CUDA_SUCCESS;
+}
+
+void CudaPlatform::host_unregister(DeviceId dev, void* ptr) {
+    cuCtxPushCurrent(devices_[dev].ctx);
+    CUresult err = cuMemHostUnregister(ptr);
+    CHECK_CUDA(err, "cuMemHostUnregister()");
+    cuCtxPopCurrent(NULL);
+}
+
+void CudaPlatform::mem_advise(DeviceId dev, void* ptr, int64_t size, MemAdvice advice) {
+    CUmem_advise cuda_advice;
+    switch (advice) {
+        case MemAdvice::ReadMostly:        cuda_advice = CU_MEM_ADVISE_SET_READ_MOSTLY;        break;
+        case MemAdvice::PreferredLocation: cuda_advice = CU_MEM_ADVISE_SET_PREFERRED_LOCATION; break;
+        case MemAdvice::AccessedBy:        cuda_advice = CU_MEM_ADVISE_SET_ACCESSED_BY;        break;
+        case MemAdvice::WillNeed:          return mem_prefetch(dev, ptr, size);
+        default:
+            // access patterns are not exposed by the driver
+            return;
+    }
+
+    cuCtxPushCurrent(devices_[dev].ctx);
+    CUresult err = cuMemAdvise((CUdeviceptr)ptr, size, cuda_advice, devices_[dev].dev);
+    cuCtxPopCurrent(NULL);
+    if (!is_unsupported_hint(err))
+        CHECK_CUDA(err, "cuMemAdvise()");
+}
+
+void CudaPlatform::mem_prefetch(DeviceId dev, void* ptr, int64_t size) {
+    cuCtxPushCurrent(devices_[dev].ctx);
+    CUresult err = cuMemPrefetchAsync((CUdeviceptr)ptr, size, devices_[dev].dev, 0);
+    cuCtxPopCurrent(NULL);
+    if (!is_unsupported_hint(err))
+        CHECK_CUDA(err, "cuMemPrefetchAsync()");
+}
+
+bool CudaPlatform::is_unsupported_hint(CUresult err) {
+    // Memory that is not managed, and devices without concurrent managed access, reject hints with these errors
+    if (err != CUDA_ERROR_INVALID_VALUE && err != CUDA_ERROR_INVALID_DEVICE && err != CUDA_ERROR_NOT_SUPPORTED)
+        return false;
+    debug("Memory hint ignored by the CUDA driver (error %)", err);
+    return true;
+}
+
 void CudaPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params) {
     cuCtxPushCurrent(devices_[dev].ctx);
+    launch_function(dev, load_kernel(dev, launch_params.file_name, launch_params.kernel_name), launch_params);
+    cuCtxPopCurrent(NULL);
+}
 
-    auto func = load_kernel(dev, launch_params.file_name, launch_params.kernel_name);
+void* CudaPlatform::get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) {
+    cuCtxPushCurrent(devices_[dev].ctx);
+    auto func = load_kernel(dev, file_name, kernel_name);
+    cuCtxPopCurrent(NULL);
+    return func;
+}
+
+void CudaPlatform::launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) {
+    cuCtxPushCurrent(devices_[dev].ctx);
+    launch_function(dev, static_cast<CUfunction>(kernel), launch_params);
+    cuCtxPopCurrent(NULL);
+}
 
+void CudaPlatform::launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) {
+    // The packed arguments follow the layout of the parameter buffer, and are copied by the driver at once
+    size_t size = layout.size;
+    void* extra[] = {
+        CU_LAUNCH_PARAM_BUFFER_POINTER, const_cast<void*>(args),
+        CU_LAUNCH_PARAM_BUFFER_SIZE, &size,
+        CU_LAUNCH_PARAM_END
+    };
+    cuCtxPushCurrent(devices_[dev].ctx);
+    launch_function(dev, static_cast<CUfunction>(kernel), launch_params, extra);
+    cuCtxPopCurrent(NULL);
+}
+
+void CudaPlatform::launch_function(DeviceId dev, CUfunction func, const LaunchParams& launch_params, void** extra) {
     CUevent start, end;
     if (runtime_->profiling_enabled()) {
         erase_profiles(false);
@@ -247,7 +442,7 @@ void CudaPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params
         launch_params.grid[1] / launch_params.block[1],
         launch_params.grid[2] / launch_params.block[2],
         launch_params.block[0], launch_params.block[1], launch_params.block[2],
-        0, nullptr, launch_params.args.data, nullptr);
+        0, nullptr, extra ? nullptr : launch_params.args.data, extra);
     CHECK_CUDA(err, "cuLaunchKernel()");
 
     if (runtime_->profiling_enabled()) {
@@ -255,7 +450,6 @@ void CudaPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params
         CHECK_CUDA(cuEventRecord(end, 0), "cuEventRecord()");
         profiles_.push_front(new ProfileData { this, devices_[dev].ctx, start, end });
     }
-    cuCtxPopCurrent(NULL);
 }
 
 void CudaPlatform::synchronize(DeviceId dev) {
@@ -267,6 +461,7 @@ void CudaPlatform::synchronize(DeviceId dev) {
 
     cuCtxPopCurrent(NULL);
     erase_profiles(false);
+    reclaim_deferred(dev, true);
 }
 
 void CudaPlatform::copy(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
@@ -283,6 +478,121 @@ void CudaPlatform::copy(DeviceId dev_src, const void* src, int64_t offset_src, D
     cuCtxPopCurrent(NULL);
 }
 
+void* CudaPlatform::alloc_pitched(DeviceId dev, int64_t width, int64_t height, int64_t depth, int64_t& pitch) {
+    cuCtxPushCurrent(devices_[dev].ctx);
+
+    // The driver picks the pitch that gives coalesced accesses for 16-byte elements
+    CUdeviceptr mem;
+    size_t mem_pitch;
+    CUresult err = cuMemAllocPitch(&mem, &mem_pitch, width, height * depth, 16);
+    CHECK_CUDA(err, "cuMemAllocPitch()");
+    pitch = mem_pitch;
+
+    cuCtxPopCurrent(NULL);
+    return (void*)mem;
+}
+
+void CudaPlatform::copy_3d(CopyKind kind, DeviceId dev_src, const void* src, Pitch src_pitch, DeviceId dev_dst, void* dst, Pitch dst_pitch, const Region3D& region) {
+    // The driver requires the slice pitch to be a whole number of rows
+    if ((kind == CopyKind::DeviceToDevice && dev_src != dev_dst) ||
+        src_pitch.slice % src_pitch.row != 0 || dst_pitch.slice % dst_pitch.row != 0)
+        return Platform::copy_3d(kind, dev_src, src, src_pitch, dev_dst, dst, dst_pitch, region);
+
+    DeviceId dev = kind == CopyKind::HostToDevice ? dev_dst : dev_src;
+    cuCtxPushCurrent(devices_[dev].ctx);
+
+    CUDA_MEMCPY3D desc = {};
+    desc.srcXInBytes = region.src_x;
+    desc.srcY = region.src_y;
+    desc.srcZ = region.src_z;
+    desc.srcPitch = src_pitch.row;
+    desc.srcHeight = src_pitch.slice / src_pitch.row;
+    if (kind == CopyKind::HostToDevice) {
+        desc.srcMemoryType = CU_MEMORYTYPE_HOST;
+        desc.srcHost = src;
+    } else {
+        desc.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+        desc.srcDevice = (CUdeviceptr)src;
+    }
+    desc.dstXInBytes = region.dst_x;
+    desc.dstY = region.dst_y;
+    desc.dstZ = region.dst_z;
+    desc.dstPitch = dst_pitch.row;
+    desc.dstHeight = dst_pitch.slice / dst_pitch.row;
+    if (kind == CopyKind::DeviceToHost) {
+        desc.dstMemoryType = CU_MEMORYTYPE_HOST;
+        desc.dstHost = dst;
+    } else {
+        desc.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+        desc.dstDevice = (CUdeviceptr)dst;
+    }
+    desc.WidthInBytes = region.width;
+    desc.Height = region.height;
+    desc.Depth = region.depth;
+
+    CUresult err = cuMemcpy3D(&desc);
+    CHECK_CUDA(err, "cuMemcpy3D()");
+
+    cuCtxPopCurrent(NULL);
+}
+
+void CudaPlatform::copy_batch(CopyKind kind, DeviceId dev_src, DeviceId dev_dst, const CopyRegion* regions, size_t count) {
+    if (kind == CopyKind::DeviceToDevice && dev_src != dev_dst)
+        return Platform::copy_batch(kind, dev_src, dev_dst, regions, count);
+
+    DeviceId dev = kind == CopyKind::HostToDevice ? dev_dst : dev_src;
+    cuCtxPushCurrent(devices_[dev].ctx);
+
+    // All the copies are issued asynchronously on the default stream, which is synchronized once
+    CUresult err;
+    for (size_t i = 0; i < count; ++i) {
+        auto& region = regions[i];
+        switch (kind) {
+            case CopyKind::DeviceToDevice:
+                err = cuMemcpyDtoDAsync((CUdeviceptr)region.dst + region.offset_dst, (CUdeviceptr)region.src + region.offset_src, region.size, 0);
+                CHECK_CUDA(err, "cuMemcpyDtoDAsync()");
+                break;
+            case CopyKind::HostToDevice:
+                err = cuMemcpyHtoDAsync((CUdeviceptr)region.dst + region.offset_dst, (const char*)region.src + region.offset_src, region.size, 0);
+                CHECK_CUDA(err, "cuMemcpyHtoDAsync()");
+                break;
+            case CopyKind::DeviceToHost:
+                err = cuMemcpyDtoHAsync((char*)region.dst + region.offset_dst, (CUdeviceptr)region.src + region.offset_src, region.size, 0);
+                CHECK_CUDA(err, "cuMemcpyDtoHAsync()");
+                break;
+        }
+    }
+    err = cuStreamSynchronize(0);
+    CHECK_CUDA(err, "cuStreamSynchronize()");
+
+    cuCtxPopCurrent(NULL);
+}
+
+void CudaPlatform::memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) {
+    // The driver only fills with 8, 16 or 32-bit values
+    CUdeviceptr dst_mem = (CUdeviceptr)ptr + offset;
+    if (pattern_size > 4 || dst_mem % pattern_size != 0)
+        return Platform::memset(dev, ptr, offset, pattern, pattern_size, size);
+
+    cuCtxPushCurrent(devices_[dev].ctx);
+
+    CUresult err;
+    if (pattern_size == 1) {
+        err = cuMemsetD8(dst_mem, *static_cast<const uint8_t*>(pattern), size);
+        CHECK_CUDA(err, "cuMemsetD8()");
+    } else if (pattern_size == 2) {
+        err = cuMemsetD16(dst_mem, *static_cast<const uint16_t*>(pattern), size / 2);
+        CHECK_CUDA(err, "cuMemsetD16()");
+    } else {
+        err = cuMemsetD32(dst_mem, *static_cast<const uint32_t*>(pattern), size / 4);
+        CHECK_CUDA(err, "cuMemsetD32()");
+    }
+    err = cuCtxSynchronize();
+    CHECK_CUDA(err, "cuCtxSynchronize()");
+
+    cuCtxPopCurrent(NULL);
+}
+
 void CudaPlatform::copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
     cuCtxPushCurrent(devices_[dev_dst].ctx);
 
@@ -304,9 +614,13 @@ void CudaPlatform::copy_to_host(DeviceId dev_src, const void* src, int64_t offse
     cuCtxPopCurrent(NULL);
 }
 
-CUfunction CudaPlatform::load_kernel(DeviceId dev, const std::string& filename, const std::string& kernelname) {
+CUfunction CudaPlatform::load_kernel(DeviceId dev, std::string_view file_name, std::string_view kernel_name) {
     auto& cuda_dev = devices_[dev];
 
+    if (auto func = cuda_dev.loaded.find(file_name, kernel_name))
+        return *func;
+    std::string filename(file_name), kernelname(kernel_name);
+
     // lock the device when the function cache is accessed
     cuda_dev.lock();
 
@@ -314,7 +628,16 @@ CUfunction CudaPlatform::load_kernel(DeviceId dev, const std::string& filename,
     auto canonical = std::filesystem::weakly_canonical(filename);
     auto& mod_cache = cuda_dev.modules;
     auto mod_it = mod_cache.find(canonical.string());
-    if (mod_it == mod_cache.end()) {
+    auto compiling_it = cuda_dev.compiling.find(canonical.string());
+    if (mod_it == mod_cache.end() && compiling_it != cuda_dev.compiling.end()) {
+        // another thread compiles the module, wait for it instead of compiling it again
+        auto compiled = compiling_it->second;
+        cuda_dev.unlock();
+        mod = compiled.get();
+        cuda_dev.lock();
+    } else if (mod_it == mod_cache.end()) {
+        std::promise<CUmodule> compiled;
+        cuda_dev.compiling.emplace(canonical.string(), compiled.get_future().share());
         cuda_dev.unlock();
 
         bool use_nvptx = true;
@@ -347,6 +670,8 @@ CUfunction CudaPlatform::load_kernel(DeviceId dev, const std::string& filename,
 
         cuda_dev.lock();
         mod_cache[canonical.string()] = mod;
+        cuda_dev.compiling.erase(canonical.string());
+        compiled.set_value(mod);
     } else {
         mod = mod_it->second;
     }
@@ -385,7 +710,7 @@ CUfunction CudaPlatform::load_kernel(DeviceId dev, const std::string& filename,
 
     cuda_dev.unlock();
 
-    return func;
+    return cuda_dev.loaded.insert(filename, canonical.string(), kernelname, func);
 }
 
 #ifdef AnyDSL_runtime_HAS_LLVM_SUPPORT
@@ -3,9 +3,11 @@
 
 #include "platform.h"
 #include "runtime.h"
+#include "loaded_kernels.h"
 
 #include <atomic>
 #include <forward_list>
+#include <future>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -28,16 +30,36 @@ public:
 
 protected:
     void* alloc(DeviceId dev, int64_t size) override;
+    void* try_alloc(DeviceId dev, int64_t size) override;
+    void* alloc_ex(DeviceId dev, int64_t size, const AllocProps& props) override;
     void* alloc_host(DeviceId dev, int64_t size) override;
     void* alloc_unified(DeviceId dev, int64_t size) override;
     void* get_device_ptr(DeviceId, void* ptr) override;
     void release(DeviceId dev, void* ptr) override;
+    void release_deferred(DeviceId dev, void* ptr) override;
     void release_host(DeviceId dev, void* ptr) override;
+    bool host_register(DeviceId dev, void* ptr, int64_t size, int32_t flags) override;
+    void host_unregister(DeviceId dev, void* ptr) override;
+    bool has_pinned_host_memory(DeviceId) const override { return true; }
+    void mem_advise(DeviceId dev, void* ptr, int64_t size, MemAdvice advice) override;
+    void mem_prefetch(DeviceId dev, void* ptr, int64_t size) override;
+    /// Returns whether the error tells that the driver cannot honor a memory hint, in which case the hint is ignored.
+    static bool is_unsupported_hint(CUresult err);
 
     void launch_kernel(DeviceId dev, const LaunchParams& launch_params) override;
+    void* get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) override;
+    void launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) override;
+    void launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) override;
+    /// Launches a function, with the context of the device already current.
+    /// The arguments are passed as a parameter buffer when `extra` is given, one by one otherwise.
+    void launch_function(DeviceId dev, CUfunction func, const LaunchParams& launch_params, void** extra = nullptr);
     void synchronize(DeviceId dev) override;
 
     void copy(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override;
+    void* alloc_pitched(DeviceId dev, int64_t width, int64_t height, int64_t depth, int64_t& pitch) override;
+    void copy_3d(CopyKind kind, DeviceId dev_src, const void* src, Pitch src_pitch, DeviceId dev_dst, void* dst, Pitch dst_pitch, const Region3D& region) override;
+    void copy_batch(CopyKind kind, DeviceId dev_src, DeviceId dev_dst, const CopyRegion* regions, size_t count) override;
+    void memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) override;
     void copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override;
     void copy_to_host(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) override;
 
@@ -54,7 +76,15 @@ protected:
         CUjit_target compute_capability;
         std::atomic_flag locked = ATOMIC_FLAG_INIT;
         std::unordered_map<std::string, CUmodule> modules;
+        /// Modules being compiled, which other threads loading the same file wait for.
+        std::unordered_map<std::string, std::shared_future<CUmodule>> compiling;
         std::unordered_map<CUmodule, FunctionMap> functions;
+        /// Functions returned by `load_kernel()`, by file and function name, which launches look up without taking the device lock.
+        LoadedKernels<CUfunction> loaded;
+        /// Allocations released with `release_deferred()`, in the order of the events that they wait for.
+        std::vector<std::pair<CUevent, CUdeviceptr>> deferred;
+        /// Allocations of `alloc_ex()` aligned past the driver's alignment, mapped to the base of the larger allocation that holds them.
+        std::unordered_map<CUdeviceptr, CUdeviceptr> aligned;
         std::string name;
 
         DeviceData() {}
@@ -64,8 +94,12 @@ protected:
             , ctx(data.ctx)
             , compute_capability(data.compute_capability)
             , modules(std::move(data.modules))
+            , compiling(std::move(data.compiling))
             , functions(std::move(data.functions))
-            , name(std::move(name))
+            , loaded(std::move(data.loaded))
+            , deferred(std::move(data.deferred))
+            , aligned(std::move(data.aligned))
+            , name(std::move(data.name))
         {}
 
         void lock() {
@@ -77,6 +111,11 @@ protected:
         }
     };
 
+    /// Returns the pointer to pass to `cuMemFree()` for an allocation of this platform.
+    CUdeviceptr allocation_base(DeviceId dev, void* ptr);
+    /// Releases the deferred allocations whose events have completed, or all of them after a synchronization.
+    void reclaim_deferred(DeviceId dev, bool synchronized);
+
     std::vector<DeviceData> devices_;
 
     bool dump_binaries = false;
@@ -92,7 +131,7 @@ protected:
     std::forward_list<ProfileData*> profiles_;
     void erase_profiles(bool);
 
-    CUfunction load_kernel(DeviceId dev, const std::string& filename, const std::string& kernelname);
+    CUfunction load_kernel(DeviceId dev, std::string_view file_name, std::string_view kernel_name);
 
     std::string compile_nvptx(DeviceId dev, const std::string& filename, const std::string& program_string) const;
     std::string compile_nvvm(DeviceId dev, const std::string& filename, const std::string& program_string) const;
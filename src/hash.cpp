@@ -0,0 +1,106 @@
+#include "hash.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HASH_HAS_SSE2
+#endif
+
+static constexpr uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t prime32_1 = 0x9E3779B1ULL;
+
+// Stripes are mixed with these keys, and the accumulators are scrambled after each block of stripes
+static constexpr int stripe_size = 64;
+static constexpr int stripes_per_block = 16;
+alignas(16) static const uint64_t keys[8] = {
+    0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+    0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL, 0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL
+};
+
+/// Multiplies two 64-bit values and folds the 128-bit product.
+static uint64_t mul_fold64(uint64_t a, uint64_t b) {
+    uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+    return lower ^ upper;
+}
+
+static uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    return h ^ (h >> 32);
+}
+
+#ifdef HASH_HAS_SSE2
+static void accumulate(uint64_t* acc, const unsigned char* stripe) {
+    auto acc_v = reinterpret_cast<__m128i*>(acc);
+    auto key_v = reinterpret_cast<const __m128i*>(keys);
+    for (int i = 0; i < 4; ++i) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripe) + i);
+        __m128i key  = _mm_xor_si128(data, _mm_load_si128(key_v + i));
+        __m128i prod = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m128i swap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        acc_v[i] = _mm_add_epi64(acc_v[i], _mm_add_epi64(prod, swap));
+    }
+}
+#else
+static void accumulate(uint64_t* acc, const unsigned char* stripe) {
+    uint64_t data[8];
+    memcpy(data, stripe, sizeof(data));
+    for (int i = 0; i < 8; ++i) {
+        uint64_t key = data[i] ^ keys[i];
+        acc[i] += (key & 0xFFFFFFFF) * (key >> 32) + data[i ^ 1];
+    }
+}
+#endif
+
+static void scramble(uint64_t* acc) {
+    for (int i = 0; i < 8; ++i) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= keys[7 - i];
+        acc[i] *= prime32_1;
+    }
+}
+
+static uint64_t merge(const uint64_t* acc, uint64_t seed, int key_offset) {
+    uint64_t h = seed;
+    for (int i = 0; i < 8; i += 2)
+        h += mul_fold64(acc[i] ^ keys[(i + key_offset) % 8], acc[i + 1] ^ keys[(i + key_offset + 1) % 8]);
+    return avalanche(h);
+}
+
+Hash128 hash_bytes(const void* data, int64_t size) {
+    alignas(16) uint64_t acc[8] = {
+        prime32_1, prime64_1, prime64_2, prime64_3,
+        prime64_1 ^ prime64_2, prime64_2 ^ prime64_3, prime64_3 ^ prime32_1, prime64_1 ^ prime32_1
+    };
+    auto ptr = static_cast<const unsigned char*>(data);
+
+    int64_t num_stripes = size / stripe_size;
+    for (int64_t i = 0; i < num_stripes; ++i) {
+        accumulate(acc, ptr + i * stripe_size);
+        if ((i + 1) % stripes_per_block == 0)
+            scramble(acc);
+    }
+
+    // The remaining bytes are padded with zeros, the size disambiguates the padding
+    int64_t tail = size - num_stripes * stripe_size;
+    if (tail > 0) {
+        unsigned char last[stripe_size] = {};
+        memcpy(last, ptr + num_stripes * stripe_size, tail);
+        accumulate(acc, last);
+    }
+
+    uint64_t length = uint64_t(size);
+    return Hash128 {
+        merge(acc, length * prime64_1, 0),
+        merge(acc, ~length * prime64_2, 3)
+    };
+}
@@ -0,0 +1,17 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+
+/// A 128-bit content hash, wide enough for collisions to be negligible when identifying buffers by their contents.
+struct Hash128 {
+    uint64_t lo, hi;
+
+    bool operator == (const Hash128& other) const { return lo == other.lo && hi == other.hi; }
+    bool operator <  (const Hash128& other) const { return lo < other.lo || (lo == other.lo && hi < other.hi); }
+};
+
+/// Hashes a block of memory. Processes 64 bytes per step with 32x32-bit multiplies, which map to SSE2 on x86.
+Hash128 hash_bytes(const void* data, int64_t size);
+
+#endif
@@ -324,12 +324,26 @@ void HSAPlatform::release(DeviceId, void* ptr) {
 }
 
 void HSAPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params) {
+    dispatch_kernel(dev, load_kernel(dev, launch_params.file_name, launch_params.kernel_name), launch_params);
+}
+
+void* HSAPlatform::get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) {
+    return &load_kernel(dev, file_name, kernel_name);
+}
+
+void HSAPlatform::launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) {
+    dispatch_kernel(dev, *static_cast<KernelInfo*>(kernel), launch_params);
+}
+
+void HSAPlatform::launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) {
+    dispatch_kernel(dev, *static_cast<KernelInfo*>(kernel), launch_params, &layout, args);
+}
+
+void HSAPlatform::dispatch_kernel(DeviceId dev, KernelInfo& kernel_info, const LaunchParams& launch_params, const ArgLayout* layout, const void* packed_args) {
     auto queue = devices_[dev].queue;
     if (!queue)
         error("The selected HSA device '%' cannot execute kernels", dev);
 
-    auto& kernel_info = load_kernel(dev, launch_params.file_name, launch_params.kernel_name);
-
     auto align_up = [&] (unsigned int start, unsigned int align) -> unsigned int {
         return (start + align - 1U) & -align;
     };
@@ -347,12 +361,18 @@ void HSAPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params)
         }
         void*  cur   = kernel_info.kernarg_segment;
         size_t space = kernel_info.kernarg_segment_size;
-        for (uint32_t i = 0; i < launch_params.num_args; i++) {
-            // align base address for next kernel argument
-            if (!std::align(launch_params.args.aligns[i], launch_params.args.alloc_sizes[i], cur, space))
-                error("Incorrect kernel argument alignment detected");
-            std::memcpy(cur, launch_params.args.data[i], launch_params.args.sizes[i]);
-            cur = reinterpret_cast<uint8_t*>(cur) + launch_params.args.alloc_sizes[i];
+        if (packed_args && reinterpret_cast<uintptr_t>(cur) % layout->align == 0 && layout->size <= space) {
+            // packed arguments are laid out as in the kernarg segment
+            std::memcpy(cur, packed_args, layout->size);
+            cur = reinterpret_cast<uint8_t*>(cur) + layout->size;
+        } else {
+            for (uint32_t i = 0; i < launch_params.num_args; i++) {
+                // align base address for next kernel argument
+                if (!std::align(launch_params.args.aligns[i], launch_params.args.alloc_sizes[i], cur, space))
+                    error("Incorrect kernel argument alignment detected");
+                std::memcpy(cur, launch_params.args.data[i], launch_params.args.sizes[i]);
+                cur = reinterpret_cast<uint8_t*>(cur) + launch_params.args.alloc_sizes[i];
+            }
         }
 
         size_t total = reinterpret_cast<uint8_t*>(cur) - reinterpret_cast<uint8_t*>(kernel_info.kernarg_segment);
@@ -449,17 +469,78 @@ void HSAPlatform::copy(const void* src, int64_t offset_src, void* dst, int64_t o
     CHECK_HSA(status, "hsa_memory_copy()");
 }
 
-HSAPlatform::KernelInfo& HSAPlatform::load_kernel(DeviceId dev, const std::string& filename, const std::string& kernelname) {
+void* HSAPlatform::get_device_ptr(DeviceId dev, void* ptr) {
+    // Registered host memory may be mapped at a different address for the agent
+    auto& hsa_dev = devices_[dev];
+    hsa_dev.lock();
+    auto it = hsa_dev.registered.find(ptr);
+    void* agent_ptr = it != hsa_dev.registered.end() ? it->second : ptr;
+    hsa_dev.unlock();
+    return agent_ptr;
+}
+
+bool HSAPlatform::host_register(DeviceId dev, void* ptr, int64_t size, int32_t) {
+    auto& hsa_dev = devices_[dev];
+    void* agent_ptr = nullptr;
+    hsa_status_t status = hsa_amd_memory_lock(ptr, size, &hsa_dev.agent, 1, &agent_ptr);
+    if (status != HSA_STATUS_SUCCESS) {
+        debug("hsa_amd_memory_lock() failed for HSA device %", dev);
+        return false;
+    }
+
+    hsa_dev.lock();
+    hsa_dev.registered[ptr] = agent_ptr;
+    hsa_dev.unlock();
+    return true;
+}
+
+void HSAPlatform::host_unregister(DeviceId dev, void* ptr) {
+    auto& hsa_dev = devices_[dev];
+    hsa_dev.lock();
+    hsa_dev.registered.erase(ptr);
+    hsa_dev.unlock();
+
+    hsa_status_t status = hsa_amd_memory_unlock(ptr);
+    CHECK_HSA(status, "hsa_amd_memory_unlock()");
+}
+
+void HSAPlatform::memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) {
+    // The runtime only fills with 32-bit values, smaller patterns are replicated
+    auto dst = (char*)ptr + offset;
+    if (pattern_size > 4 || reinterpret_cast<uintptr_t>(dst) % 4 != 0 || size % 4 != 0)
+        return Platform::memset(dev, ptr, offset, pattern, pattern_size, size);
+
+    uint32_t value;
+    for (int64_t i = 0; i < 4; i += pattern_size)
+        std::memcpy(reinterpret_cast<char*>(&value) + i, pattern, pattern_size);
+    hsa_status_t status = hsa_amd_memory_fill(dst, value, size / 4);
+    CHECK_HSA(status, "hsa_amd_memory_fill()");
+}
+
+HSAPlatform::KernelInfo& HSAPlatform::load_kernel(DeviceId dev, std::string_view file_name, std::string_view kernel_name) {
     auto& hsa_dev = devices_[dev];
     hsa_status_t status;
 
+    if (auto kernel_info = hsa_dev.loaded.find(file_name, kernel_name))
+        return **kernel_info;
+    std::string filename(file_name), kernelname(kernel_name);
+
     hsa_dev.lock();
 
     hsa_executable_t executable = { 0 };
     auto canonical = std::filesystem::weakly_canonical(filename);
     auto& prog_cache = hsa_dev.programs;
     auto prog_it = prog_cache.find(canonical.string());
-    if (prog_it == prog_cache.end()) {
+    auto compiling_it = hsa_dev.compiling.find(canonical.string());
+    if (prog_it == prog_cache.end() && compiling_it != hsa_dev.compiling.end()) {
+        // another thread compiles the executable, wait for it instead of compiling it again
+        auto compiled = compiling_it->second;
+        hsa_dev.unlock();
+        executable = compiled.get();
+        hsa_dev.lock();
+    } else if (prog_it == prog_cache.end()) {
+        std::promise<hsa_executable_t> compiled;
+        hsa_dev.compiling.emplace(canonical.string(), compiled.get_future().share());
         hsa_dev.unlock();
 
         if (canonical.extension() != ".gcn" && canonical.extension() != ".amdgpu")
@@ -513,6 +594,8 @@ HSAPlatform::KernelInfo& HSAPlatform::load_kernel(DeviceId dev, const std::strin
 
         hsa_dev.lock();
         prog_cache[canonical.string()] = executable;
+        hsa_dev.compiling.erase(canonical.string());
+        compiled.set_value(executable);
     } else {
         executable = prog_it->second;
     }
@@ -560,7 +643,7 @@ HSAPlatform::KernelInfo& HSAPlatform::load_kernel(DeviceId dev, const std::strin
     KernelInfo& kernel_info = kernel_it->second;
     hsa_dev.unlock();
 
-    return kernel_info;
+    return *hsa_dev.loaded.insert(filename, canonical.string(), kernelname, &kernel_info);
 }
 
 #ifdef AnyDSL_runtime_HAS_LLVM_SUPPORT
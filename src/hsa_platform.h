@@ -3,8 +3,10 @@
 
 #include "platform.h"
 #include "runtime.h"
+#include "loaded_kernels.h"
 
 #include <atomic>
+#include <future>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -26,15 +28,21 @@ protected:
     void* alloc(DeviceId dev, int64_t size) override { return alloc_hsa(size, devices_[dev].amd_coarsegrained_pool); }
     void* alloc_host(DeviceId dev, int64_t size) override { return alloc_hsa(size, devices_[dev].amd_coarsegrained_pool); }
     void* alloc_unified(DeviceId dev, int64_t size) override { return alloc_hsa(size, devices_[dev].finegrained_region); }
-    void* get_device_ptr(DeviceId, void* ptr) override { return ptr; }
+    void* get_device_ptr(DeviceId dev, void* ptr) override;
     void release(DeviceId dev, void* ptr) override;
     void release_host(DeviceId dev, void* ptr) override { release(dev, ptr); }
+    bool host_register(DeviceId dev, void* ptr, int64_t size, int32_t flags) override;
+    void host_unregister(DeviceId dev, void* ptr) override;
 
     void launch_kernel(DeviceId dev, const LaunchParams& launch_params) override;
+    void* get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) override;
+    void launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) override;
+    void launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) override;
     void synchronize(DeviceId dev) override;
 
     void copy(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size);
     void copy(DeviceId, const void* src, int64_t offset_src, DeviceId, void* dst, int64_t offset_dst, int64_t size) override { copy(src, offset_src, dst, offset_dst, size); }
+    void memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) override;
     void copy_from_host(const void* src, int64_t offset_src, DeviceId, void* dst, int64_t offset_dst, int64_t size) override { copy(src, offset_src, dst, offset_dst, size); }
     void copy_to_host(DeviceId, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) override { copy(src, offset_src, dst, offset_dst, size); }
 
@@ -64,7 +72,12 @@ protected:
         hsa_amd_memory_pool_t amd_kernarg_pool, amd_finegrained_pool, amd_coarsegrained_pool;
         std::atomic_flag locked = ATOMIC_FLAG_INIT;
         std::unordered_map<std::string, hsa_executable_t> programs;
+        /// Executables being compiled, which other threads loading the same file wait for.
+        std::unordered_map<std::string, std::shared_future<hsa_executable_t>> compiling;
         std::unordered_map<uint64_t, KernelMap> kernels;
+        /// Kernels returned by `load_kernel()`, by file and kernel name, which launches look up without taking the device lock.
+        LoadedKernels<KernelInfo*> loaded;
+        std::unordered_map<void*, void*> registered;
         std::string name;
 
         DeviceData() {}
@@ -83,7 +96,10 @@ protected:
             , amd_finegrained_pool(data.amd_finegrained_pool)
             , amd_coarsegrained_pool(data.amd_finegrained_pool)
             , programs(std::move(data.programs))
+            , compiling(std::move(data.compiling))
             , kernels(std::move(data.kernels))
+            , loaded(std::move(data.loaded))
+            , registered(std::move(data.registered))
             , name(data.name)
         {}
 
@@ -104,7 +120,8 @@ protected:
     static hsa_status_t iterate_agents_callback(hsa_agent_t, void*);
     static hsa_status_t iterate_regions_callback(hsa_region_t, void*);
     static hsa_status_t iterate_memory_pools_callback(hsa_amd_memory_pool_t, void*);
-    KernelInfo& load_kernel(DeviceId, const std::string&, const std::string&);
+    KernelInfo& load_kernel(DeviceId, std::string_view, std::string_view);
+    void dispatch_kernel(DeviceId, KernelInfo&, const LaunchParams&, const ArgLayout* = nullptr, const void* = nullptr);
     std::string compile_gcn(DeviceId, const std::string&, const std::string&) const;
     std::string emit_gcn(const std::string&, const std::string&, const std::string&, llvm::OptimizationLevel) const;
 };
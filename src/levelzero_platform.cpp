@@ -138,6 +138,18 @@ void determineDeviceCapabilities(ze_device_handle_t hDevice, LevelZeroPlatform::
     image_properties.stype = ZE_STRUCTURE_TYPE_DEVICE_IMAGE_PROPERTIES;
     WRAP_LEVEL_ZERO(zeDeviceGetImageProperties(hDevice, &image_properties));
     //std::cout << to_string(image_properties) << "\n";
+
+    // The immediate command list uses the queue group with ordinal 0, which bounds the fill pattern size
+    uint32_t groupCount = 0;
+    WRAP_LEVEL_ZERO(zeDeviceGetCommandQueueGroupProperties(hDevice, &groupCount, nullptr));
+    std::vector<ze_command_queue_group_properties_t> groupProperties(groupCount);
+    for (uint32_t group = 0; group < groupCount; ++group)
+    {
+        groupProperties[group].stype = ZE_STRUCTURE_TYPE_COMMAND_QUEUE_GROUP_PROPERTIES;
+        groupProperties[group].pNext = nullptr;
+    }
+    WRAP_LEVEL_ZERO(zeDeviceGetCommandQueueGroupProperties(hDevice, &groupCount, groupProperties.data()));
+    device.maxFillPatternSize = groupCount > 0 ? groupProperties[0].maxMemoryFillPatternSize : 0;
 }
 
 LevelZeroPlatform::LevelZeroPlatform(Runtime* runtime)
@@ -233,6 +245,16 @@ LevelZeroPlatform::~LevelZeroPlatform() {
 void* LevelZeroPlatform::alloc(DeviceId dev, int64_t size) {
     if (!size) return nullptr;
 
+    void* mem = try_alloc(dev, size);
+    if (mem == nullptr)
+        error("zeMemAllocDevice() failed for Level Zero device %", dev);
+
+    return mem;
+}
+
+void* LevelZeroPlatform::try_alloc(DeviceId dev, int64_t size) {
+    if (!size) return nullptr;
+
     ze_device_mem_alloc_desc_t device_desc;
     device_desc.stype = ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC;
     device_desc.pNext = nullptr;
@@ -241,11 +263,36 @@ void* LevelZeroPlatform::alloc(DeviceId dev, int64_t size) {
     const size_t alignment = 64;
     void* mem = nullptr;
 
+    WRAP_LEVEL_ZERO_HANDLER(
+        zeMemAllocDevice(devices_[dev].ctx, &device_desc, size, alignment, devices_[dev].device, &mem),
+        if (err == ZE_RESULT_ERROR_OUT_OF_DEVICE_MEMORY) return nullptr;
+    );
+
+    return mem;
+}
+
+void* LevelZeroPlatform::alloc_ex(DeviceId dev, int64_t size, const AllocProps& props) {
+    if (!size) return nullptr;
+
+    ze_device_mem_alloc_desc_t device_desc;
+    device_desc.stype = ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC;
+    device_desc.pNext = nullptr;
+    device_desc.flags = 0;
+    device_desc.ordinal = 0;
+
+    const size_t alignment = std::max(size_t(64), size_t(props.alignment));
+    void* mem = nullptr;
+
     WRAP_LEVEL_ZERO(zeMemAllocDevice(devices_[dev].ctx, &device_desc, size, alignment, devices_[dev].device, &mem));
 
     if (mem == nullptr)
         error("zeMemAllocDevice() failed for Level Zero device %", dev);
 
+    if (props.flags & AllocProps::ZeroInit) {
+        const uint8_t zero = 0;
+        memset(dev, mem, 0, &zero, sizeof(zero), size);
+    }
+
     return mem;
 }
 
@@ -310,15 +357,56 @@ void LevelZeroPlatform::release_host(DeviceId dev, void* ptr) {
     WRAP_LEVEL_ZERO(zeMemFree(devices_[dev].ctx, ptr));
 }
 
+void LevelZeroPlatform::mem_advise(DeviceId dev, void* ptr, int64_t size, MemAdvice advice) {
+    ze_memory_advice_t ze_advice;
+    switch (advice) {
+        case MemAdvice::ReadMostly:        ze_advice = ZE_MEMORY_ADVICE_SET_READ_MOSTLY;        break;
+        case MemAdvice::PreferredLocation: ze_advice = ZE_MEMORY_ADVICE_SET_PREFERRED_LOCATION; break;
+        case MemAdvice::WillNeed:          return mem_prefetch(dev, ptr, size);
+        default:
+            // no equivalent hint in Level Zero
+            return;
+    }
+    // Hints on memory that is not shared, or that the device does not support, are ignored
+    WRAP_LEVEL_ZERO_HANDLER(
+        zeCommandListAppendMemAdvise(devices_[dev].queue, devices_[dev].device, ptr, size, ze_advice),
+        if (err == ZE_RESULT_ERROR_INVALID_ARGUMENT || err == ZE_RESULT_ERROR_UNSUPPORTED_FEATURE) return;
+    );
+}
+
+void LevelZeroPlatform::mem_prefetch(DeviceId dev, void* ptr, int64_t size) {
+    WRAP_LEVEL_ZERO_HANDLER(
+        zeCommandListAppendMemoryPrefetch(devices_[dev].queue, ptr, size),
+        if (err == ZE_RESULT_ERROR_INVALID_ARGUMENT || err == ZE_RESULT_ERROR_UNSUPPORTED_FEATURE) return;
+    );
+}
+
 void LevelZeroPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params) {
+    append_kernel(dev, load_kernel(dev, launch_params.file_name, launch_params.kernel_name), launch_params);
+}
 
-    DeviceData& ze_dev = devices_[dev];
+void* LevelZeroPlatform::get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) {
+    return load_kernel(dev, file_name, kernel_name);
+}
+
+void LevelZeroPlatform::launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) {
+    append_kernel(dev, static_cast<ze_kernel_handle_t>(kernel), launch_params);
+}
+
+void LevelZeroPlatform::launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) {
+    append_kernel(dev, static_cast<ze_kernel_handle_t>(kernel), launch_params, &layout, args);
+}
+
+void LevelZeroPlatform::append_kernel(DeviceId dev, ze_kernel_handle_t hKernel, const LaunchParams& launch_params, const ArgLayout* layout, const void* packed_args) {
 
-    ze_kernel_handle_t hKernel = load_kernel(dev, launch_params.file_name, launch_params.kernel_name);
+    DeviceData& ze_dev = devices_[dev];
 
-    // set up arguments
+    // set up arguments, packed arguments are read at their offset in the packed buffer
     for (uint32_t argIdx = 0; argIdx < launch_params.num_args; ++argIdx) {
-        WRAP_LEVEL_ZERO(zeKernelSetArgumentValue(hKernel, argIdx, launch_params.args.sizes[argIdx], launch_params.args.data[argIdx]));
+        const void* value = packed_args
+            ? static_cast<const char*>(packed_args) + layout->offsets[argIdx]
+            : launch_params.args.data[argIdx];
+        WRAP_LEVEL_ZERO(zeKernelSetArgumentValue(hKernel, argIdx, launch_params.args.sizes[argIdx], value));
     }
 
     WRAP_LEVEL_ZERO(zeKernelSetGroupSize(hKernel, launch_params.block[0] , launch_params.block[1] , launch_params.block[2]));
@@ -401,6 +489,15 @@ void LevelZeroPlatform::copy(DeviceId dev_src, const void* src, int64_t offset_s
     WRAP_LEVEL_ZERO(zeCommandListAppendMemoryCopy(dev.queue, dst_ptr, src_ptr, size, nullptr, 0, nullptr));
 }
 
+void LevelZeroPlatform::memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) {
+    // Fill patterns must be a power of two no larger than what the queue group supports
+    if (static_cast<size_t>(pattern_size) > devices_[dev].maxFillPatternSize || (pattern_size & (pattern_size - 1)) != 0)
+        return Platform::memset(dev, ptr, offset, pattern, pattern_size, size);
+    uint8_t* dst_ptr = static_cast<uint8_t*>(ptr) + offset;
+    WRAP_LEVEL_ZERO(zeCommandListAppendMemoryFill(devices_[dev].queue, dst_ptr, pattern, pattern_size, size, nullptr, 0, nullptr));
+    synchronize(dev);
+}
+
 void LevelZeroPlatform::copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
     //assert(offset_src == 0 && offset_dst == 0);
 
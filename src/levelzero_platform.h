@@ -19,16 +19,25 @@ public:
 
 protected:
     void* alloc(DeviceId dev, int64_t size) override;
+    void* try_alloc(DeviceId dev, int64_t size) override;
+    void* alloc_ex(DeviceId dev, int64_t size, const AllocProps& props) override;
     void* alloc_host(DeviceId, int64_t) override;
     void* alloc_unified(DeviceId, int64_t) override;
     void* get_device_ptr(DeviceId, void*) override { command_unavailable("get_device_ptr"); }
     void release(DeviceId dev, void* ptr) override;
     void release_host(DeviceId, void*) override;
+    bool has_pinned_host_memory(DeviceId) const override { return true; }
+    void mem_advise(DeviceId dev, void* ptr, int64_t size, MemAdvice advice) override;
+    void mem_prefetch(DeviceId dev, void* ptr, int64_t size) override;
 
     void launch_kernel(DeviceId dev, const LaunchParams& launch_params) override;
+    void* get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) override;
+    void launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) override;
+    void launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) override;
     void synchronize(DeviceId dev) override;
 
     void copy(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override;
+    void memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) override;
     void copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override;
     void copy_to_host(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) override;
 
@@ -49,6 +58,7 @@ protected:
         std::unordered_map<std::string, ze_module_handle_t> modules;
         std::unordered_map<ze_module_handle_t, KernelMap> kernels;
         double timerResolution;
+        size_t maxFillPatternSize = 0;
 
         DeviceData(
             LevelZeroPlatform* parent,
@@ -68,6 +78,7 @@ protected:
     std::vector<ze_context_handle_t> contexts_;
 
     ze_kernel_handle_t load_kernel(DeviceId dev, const std::string& filename, const std::string& kernelname);
+    void append_kernel(DeviceId dev, ze_kernel_handle_t hKernel, const LaunchParams& launch_params, const ArgLayout* = nullptr, const void* = nullptr);
     friend void determineDeviceCapabilities(ze_device_handle_t hDevice, LevelZeroPlatform::DeviceData& device);
 };
 
@@ -0,0 +1,104 @@
+#ifndef LOADED_KERNELS_H
+#define LOADED_KERNELS_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/// The kernels loaded by a platform device, which launches look up by file and kernel name.
+/// Kernels are stored once per canonical file path, and the file names given to lookups are mapped to that path.
+/// Lookups read an immutable snapshot of the map through an atomic pointer, so they neither lock nor allocate.
+/// Inserting copies the snapshot, and replaced snapshots are kept until the map is destroyed, since lookups may still read them.
+template <typename Value>
+class LoadedKernels {
+public:
+    LoadedKernels() : state_(new State) {}
+    LoadedKernels(const LoadedKernels&) = delete;
+    /// Only meant for moving the platform device structures while they are set up, before any concurrent access.
+    LoadedKernels(LoadedKernels&&) = default;
+
+    /// Returns the kernel of the given file and name, or `nullptr` if it is not loaded.
+    const Value* find(std::string_view file_name, std::string_view kernel_name) const {
+        auto snapshot = state_->current.load(std::memory_order_acquire);
+        auto file = snapshot->files.find(file_name);
+        if (file == snapshot->files.end())
+            return nullptr;
+        auto it = snapshot->kernels.find(Key(file->second, kernel_name));
+        return it != snapshot->kernels.end() ? it->second : nullptr;
+    }
+
+    /// Inserts a kernel, unless it is already loaded. Returns the kernel in the map.
+    const Value& insert(std::string_view file_name, std::string_view canonical_name, std::string_view kernel_name, const Value& value) {
+        std::lock_guard<std::mutex> guard(state_->lock);
+        auto current = state_->current.load(std::memory_order_relaxed);
+        Key key(state_->intern(canonical_name), state_->intern(kernel_name));
+        auto file = state_->intern(file_name);
+        auto it = current->kernels.find(key);
+        if (it != current->kernels.end() && current->files.count(file))
+            return *it->second;
+
+        auto snapshot = std::make_unique<Snapshot>(*current);
+        snapshot->files.emplace(file, key.first);
+        auto kernel = snapshot->kernels.emplace(key, nullptr).first;
+        if (!kernel->second)
+            kernel->second = &state_->values.emplace_back(value);
+        state_->current.store(snapshot.get(), std::memory_order_release);
+        state_->snapshots.push_back(std::move(snapshot));
+        return *kernel->second;
+    }
+
+private:
+    /// Views of the canonical file path and of the kernel name, which point to the interned names.
+    typedef std::pair<std::string_view, std::string_view> Key;
+
+    struct KeyHash {
+        size_t operator () (const Key& key) const {
+            std::hash<std::string_view> hash;
+            return hash(key.first) * 31 + hash(key.second);
+        }
+    };
+
+    struct Snapshot {
+        std::unordered_map<std::string_view, std::string_view> files;
+        std::unordered_map<Key, const Value*, KeyHash> kernels;
+    };
+
+    struct State {
+        State() {
+            snapshots.emplace_back(new Snapshot);
+            current.store(snapshots.back().get(), std::memory_order_relaxed);
+        }
+
+        /// Guards everything but `current` for inserts.
+        std::mutex lock;
+        std::deque<std::string> storage;
+        std::unordered_set<std::string_view> names;
+        /// Elements of a deque do not move when others are appended, so snapshots refer to them.
+        std::deque<Value> values;
+        /// Every snapshot published so far, the last of which is the current one.
+        std::vector<std::unique_ptr<Snapshot>> snapshots;
+        std::atomic<const Snapshot*> current { nullptr };
+
+        /// Returns a view of a copy of the name that lives as long as the map. Requires `lock` to be held.
+        std::string_view intern(std::string_view name) {
+            auto it = names.find(name);
+            if (it != names.end())
+                return *it;
+            std::string_view interned = storage.emplace_back(name);
+            names.insert(interned);
+            return interned;
+        }
+    };
+
+    std::unique_ptr<State> state_;
+};
+
+#endif
@@ -210,26 +210,7 @@ OpenCLPlatform::OpenCLPlatform(Runtime* runtime)
             devices_[dev].ctx = clCreateContext(ctx_props, 1, &devices_[dev].dev, NULL, NULL, &err);
             CHECK_OPENCL(err, "clCreateContext()");
 
-            // create command queue
-            devices_[dev].queue = NULL;
-            #ifdef CL_VERSION_2_0
-            if (version_major >= 2) {
-                cl_queue_properties queue_props[3] = { 0, 0, 0 };
-                if (runtime_->profiling_enabled()) {
-                    queue_props[0] = CL_QUEUE_PROPERTIES;
-                    queue_props[1] = CL_QUEUE_PROFILING_ENABLE;
-                }
-                devices_[dev].queue = clCreateCommandQueueWithProperties(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
-                CHECK_OPENCL(err, "clCreateCommandQueueWithProperties()");
-            }
-            #endif
-            if (!devices_[dev].queue) {
-                cl_command_queue_properties queue_props = 0;
-                if (runtime_->profiling_enabled())
-                    queue_props = CL_QUEUE_PROFILING_ENABLE;
-                devices_[dev].queue = clCreateCommandQueue(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
-                CHECK_OPENCL(err, "clCreateCommandQueue()");
-            }
+            devices_[dev].queue = create_queue(DeviceId(dev), runtime_->profiling_enabled());
 
             if (platform_name.find("FPGA") != std::string::npos) {
                 devices_[dev].is_intel_fpga = true;
@@ -271,6 +252,28 @@ OpenCLPlatform::OpenCLPlatform(Runtime* runtime)
     delete[] platforms;
 }
 
+cl_command_queue OpenCLPlatform::create_queue(DeviceId dev, bool profiling) {
+    cl_int err = CL_SUCCESS;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major >= 2) {
+        cl_queue_properties queue_props[3] = { 0, 0, 0 };
+        if (profiling) {
+            queue_props[0] = CL_QUEUE_PROPERTIES;
+            queue_props[1] = CL_QUEUE_PROFILING_ENABLE;
+        }
+        cl_command_queue queue = clCreateCommandQueueWithProperties(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
+        CHECK_OPENCL(err, "clCreateCommandQueueWithProperties()");
+        return queue;
+    }
+    #endif
+    cl_command_queue_properties queue_props = 0;
+    if (profiling)
+        queue_props = CL_QUEUE_PROFILING_ENABLE;
+    cl_command_queue queue = clCreateCommandQueue(devices_[dev].ctx, devices_[dev].dev, queue_props, &err);
+    CHECK_OPENCL(err, "clCreateCommandQueue()");
+    return queue;
+}
+
 OpenCLPlatform::~OpenCLPlatform() {
     for (size_t i = 0; i < devices_.size(); i++) {
         if (devices_[i].is_intel_fpga || devices_[i].is_xilinx_fpga)
@@ -296,24 +299,69 @@ OpenCLPlatform::~OpenCLPlatform() {
 void* OpenCLPlatform::alloc(DeviceId dev, int64_t size) {
     if (!size) return nullptr;
 
+    void* mem = try_alloc(dev, size);
+    if (mem == nullptr)
+        error("Out of memory allocating % bytes on OpenCL device %", size, dev);
+
+    return mem;
+}
+
+bool OpenCLPlatform::has_addressable_memory(DeviceId dev) const {
+    // Only SVM allocations are pointers, buffers are cl_mem handles
+    #ifdef CL_VERSION_2_0
+    return devices_[dev].version_major == 2;
+    #else
+    (void)dev;
+    return false;
+    #endif
+}
+
+void* OpenCLPlatform::try_alloc(DeviceId dev, int64_t size) {
+    if (!size) return nullptr;
+
     #ifdef CL_VERSION_2_0
     if (devices_[dev].version_major == 2) {
         cl_mem_flags flags = CL_MEM_READ_WRITE;
-        void* mem = clSVMAlloc(devices_[dev].ctx, flags, size, 0);
-        if (mem == nullptr)
-            error("clSVMAlloc() returned % for OpenCL device %", mem, dev);
-
-        return mem;
+        return clSVMAlloc(devices_[dev].ctx, flags, size, 0);
     }
     #endif
     cl_int err = CL_SUCCESS;
     cl_mem_flags flags = CL_MEM_READ_WRITE;
     cl_mem mem = clCreateBuffer(devices_[dev].ctx, flags, size, NULL, &err);
+    if (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES)
+        return nullptr;
     CHECK_OPENCL(err, "clCreateBuffer()");
 
     return (void*)mem;
 }
 
+void* OpenCLPlatform::alloc_ex(DeviceId dev, int64_t size, const AllocProps& props) {
+    if (!size) return nullptr;
+
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+    if (props.usage == AllocProps::ReadOnly)  flags = CL_MEM_READ_ONLY;
+    if (props.usage == AllocProps::WriteOnly) flags = CL_MEM_WRITE_ONLY;
+    const char zero = 0;
+    cl_int err = CL_SUCCESS;
+
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2) {
+        void* mem = clSVMAlloc(devices_[dev].ctx, flags, size, props.alignment);
+        if (mem == nullptr)
+            error("clSVMAlloc() returned % for OpenCL device %", mem, dev);
+        if (props.flags & AllocProps::ZeroInit)
+            memset(dev, mem, 0, &zero, sizeof(zero), size);
+        return mem;
+    }
+    #endif
+    // buffer objects are aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN by the implementation
+    cl_mem mem = clCreateBuffer(devices_[dev].ctx, flags, size, NULL, &err);
+    CHECK_OPENCL(err, "clCreateBuffer()");
+    if (props.flags & AllocProps::ZeroInit)
+        memset(dev, mem, 0, &zero, sizeof(zero), size);
+    return (void*)mem;
+}
+
 void* OpenCLPlatform::alloc_unified(DeviceId dev, int64_t size) {
     if (!size) return nullptr;
 
@@ -334,6 +382,102 @@ void* OpenCLPlatform::alloc_unified(DeviceId dev, int64_t size) {
     error("clSVMAlloc() requires at least OpenCL 2.0 for OpenCL device %", dev);
 }
 
+void* OpenCLPlatform::alloc_host(DeviceId dev, int64_t size) {
+    if (!size) return nullptr;
+
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return alloc_unified(dev, size);
+    #endif
+    // buffers allocated by the driver and mapped to the host are page-locked
+    cl_int err = CL_SUCCESS;
+    cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR;
+    cl_mem mem = clCreateBuffer(devices_[dev].ctx, flags, size, NULL, &err);
+    CHECK_OPENCL(err, "clCreateBuffer()");
+    void* ptr = clEnqueueMapBuffer(devices_[dev].queue, mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, NULL, NULL, &err);
+    CHECK_OPENCL(err, "clEnqueueMapBuffer()");
+
+    devices_[dev].lock();
+    devices_[dev].host_buffers[ptr] = mem;
+    devices_[dev].unlock();
+    return ptr;
+}
+
+void* OpenCLPlatform::get_device_ptr(DeviceId dev, void* ptr) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return ptr;
+    #endif
+    devices_[dev].lock();
+    auto it = devices_[dev].host_buffers.find(ptr);
+    cl_mem mem = it != devices_[dev].host_buffers.end() ? it->second : nullptr;
+    if (!mem) {
+        auto reg_it = devices_[dev].registered_buffers.find(ptr);
+        mem = reg_it != devices_[dev].registered_buffers.end() ? reg_it->second : nullptr;
+    }
+    devices_[dev].unlock();
+    if (!mem)
+        error("Pointer % was neither allocated with alloc_host() nor registered with host_register() for OpenCL device %", ptr, dev);
+    return (void*)mem;
+}
+
+bool OpenCLPlatform::host_register(DeviceId dev, void* ptr, int64_t size, int32_t flags) {
+    #ifdef CL_VERSION_2_0
+    // With system-wide SVM, any host pointer can be passed to kernels
+    if (devices_[dev].version_major == 2)
+        return (devices_[dev].svm_caps & CL_DEVICE_SVM_FINE_GRAIN_SYSTEM) != 0;
+    #endif
+    cl_int err = CL_SUCCESS;
+    cl_mem_flags mem_flags = CL_MEM_USE_HOST_PTR | ((flags & HostRegisterReadOnly) ? CL_MEM_READ_ONLY : CL_MEM_READ_WRITE);
+    cl_mem mem = clCreateBuffer(devices_[dev].ctx, mem_flags, size, ptr, &err);
+    if (err != CL_SUCCESS) {
+        debug("clCreateBuffer() with CL_MEM_USE_HOST_PTR failed for OpenCL device %: %", dev, get_opencl_error_code_str(err));
+        return false;
+    }
+
+    devices_[dev].lock();
+    devices_[dev].registered_buffers[ptr] = mem;
+    devices_[dev].unlock();
+    return true;
+}
+
+void OpenCLPlatform::host_unregister(DeviceId dev, void* ptr) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return;
+    #endif
+    devices_[dev].lock();
+    auto it = devices_[dev].registered_buffers.find(ptr);
+    cl_mem mem = it != devices_[dev].registered_buffers.end() ? it->second : nullptr;
+    if (mem)
+        devices_[dev].registered_buffers.erase(it);
+    devices_[dev].unlock();
+    if (!mem)
+        error("Pointer % was not registered with host_register() for OpenCL device %", ptr, dev);
+
+    // Pending commands may still access the memory
+    cl_int err = clFinish(devices_[dev].queue);
+    err |= clReleaseMemObject(mem);
+    CHECK_OPENCL(err, "clReleaseMemObject()");
+}
+
+void OpenCLPlatform::release_host(DeviceId dev, void* ptr) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return release(dev, ptr);
+    #endif
+    cl_mem mem = (cl_mem)get_device_ptr(dev, ptr);
+    devices_[dev].lock();
+    devices_[dev].host_buffers.erase(ptr);
+    devices_[dev].unlock();
+
+    cl_int err = clEnqueueUnmapMemObject(devices_[dev].queue, mem, ptr, 0, NULL, NULL);
+    err |= clFinish(devices_[dev].queue);
+    CHECK_OPENCL(err, "clEnqueueUnmapMemObject()");
+    err = clReleaseMemObject(mem);
+    CHECK_OPENCL(err, "clReleaseMemObject()");
+}
+
 void OpenCLPlatform::release(DeviceId dev, void* ptr) {
     #ifdef CL_VERSION_2_0
     if (devices_[dev].version_major == 2)
@@ -344,6 +488,59 @@ void OpenCLPlatform::release(DeviceId dev, void* ptr) {
     CHECK_OPENCL(err, "clReleaseMemObject()");
 }
 
+void OpenCLPlatform::release_deferred(DeviceId dev, void* ptr) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2) {
+        // FPGA kernels run on queues of their own, which an enqueued free would not wait for
+        if (devices_[dev].is_intel_fpga || devices_[dev].is_xilinx_fpga)
+            return Platform::release_deferred(dev, ptr);
+        cl_int err = clEnqueueSVMFree(devices_[dev].queue, 1, &ptr, nullptr, nullptr, 0, nullptr, nullptr);
+        CHECK_OPENCL(err, "clEnqueueSVMFree()");
+        return;
+    }
+    #endif
+    // Buffers are only destroyed once the commands that use them have completed
+    release(dev, ptr);
+}
+
+void OpenCLPlatform::mem_advise(DeviceId dev, void* ptr, int64_t size, MemAdvice advice) {
+    // OpenCL has no usage hints, only explicit migrations
+    if (advice == MemAdvice::WillNeed)
+        migrate(dev, ptr, size, false);
+    else if (advice == MemAdvice::DontNeed)
+        migrate(dev, ptr, size, true);
+}
+
+void OpenCLPlatform::mem_prefetch(DeviceId dev, void* ptr, int64_t size) {
+    migrate(dev, ptr, size, false);
+}
+
+void OpenCLPlatform::migrate(DeviceId dev, void* ptr, int64_t size, bool to_host) {
+    #ifdef CL_VERSION_1_2
+    cl_mem_migration_flags flags = to_host ? CL_MIGRATE_MEM_OBJECT_HOST : 0;
+    cl_int err = CL_SUCCESS;
+    if (devices_[dev].version_major == 2) {
+        #ifdef CL_VERSION_2_1
+        const void* svm_ptrs[] = { ptr };
+        const size_t sizes[] = { size_t(size) };
+        err = clEnqueueSVMMigrateMem(devices_[dev].queue, 1, svm_ptrs, sizes, flags, 0, NULL, NULL);
+        CHECK_OPENCL(err, "clEnqueueSVMMigrateMem()");
+        err = clFlush(devices_[dev].queue);
+        CHECK_OPENCL(err, "clFlush()");
+        #endif
+        return;
+    }
+    // buffer objects can only be migrated as a whole
+    cl_mem mem = (cl_mem)ptr;
+    err = clEnqueueMigrateMemObjects(devices_[dev].queue, 1, &mem, flags, 0, NULL, NULL);
+    CHECK_OPENCL(err, "clEnqueueMigrateMemObjects()");
+    err = clFlush(devices_[dev].queue);
+    CHECK_OPENCL(err, "clFlush()");
+    #else
+    unused(dev, ptr, size, to_host);
+    #endif
+}
+
 void time_kernel_callback(cl_event event, cl_int, void* data) {
     auto dev = reinterpret_cast<OpenCLPlatform::DeviceData*>(data);
     cl_ulong end, start;
@@ -363,39 +560,71 @@ static inline bool ends_with(std::string_view str, std::string_view suffix) {
     return str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
 }
 
-void OpenCLPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params) {
+cl_mem OpenCLPlatform::set_kernel_arg(DeviceId dev, cl_kernel kernel, const LaunchParams& launch_params, uint32_t i, bool is_spirv, bool copy_struct) {
+    if (!is_spirv && launch_params.args.types[i] == KernelArgType::Struct) {
+        // create a buffer for each structure argument
+        cl_int err = CL_SUCCESS;
+        cl_mem_flags flags = CL_MEM_READ_WRITE | (copy_struct ? CL_MEM_COPY_HOST_PTR : CL_MEM_USE_HOST_PTR);
+        cl_mem struct_buf = clCreateBuffer(devices_[dev].ctx, flags, launch_params.args.sizes[i], launch_params.args.data[i], &err);
+        CHECK_OPENCL(err, "clCreateBuffer()");
+        clSetKernelArg(kernel, i, sizeof(cl_mem), &struct_buf);
+        return struct_buf;
+    }
+    #ifdef CL_VERSION_2_0
+    if (launch_params.args.types[i] == KernelArgType::Ptr && devices_[dev].version_major == 2) {
+        cl_int err = clSetKernelArgSVMPointer(kernel, i, *(void**)launch_params.args.data[i]);
+        CHECK_OPENCL(err, "clSetKernelArgSVMPointer()");
+        return nullptr;
+    }
+    #endif
+    cl_int err = clSetKernelArg(kernel, i,
+        launch_params.args.types[i] == KernelArgType::Ptr ? sizeof(cl_mem) : launch_params.args.sizes[i],
+        launch_params.args.data[i]);
+    CHECK_OPENCL(err, "clSetKernelArg()");
+    return nullptr;
+}
+
+void OpenCLPlatform::time_kernel(DeviceId dev, cl_event event) {
+    if (runtime_->profiling_enabled() && event) {
+        cl_int err = clSetEventCallback(event, CL_COMPLETE, &time_kernel_callback, &devices_[dev]);
+        devices_[dev].atomic_data.timings_counter.fetch_add(1);
+        CHECK_OPENCL(err, "clSetEventCallback()");
+    } else {
+        cl_int err = clReleaseEvent(event);
+        CHECK_OPENCL(err, "clReleaseEvent()");
+    }
+}
+
+void OpenCLPlatform::launch_kernel_on(DeviceId dev, void* ptr, const LaunchParams& launch_params) {
+    if (devices_[dev].is_intel_fpga && launch_params.num_args == 0) {
+        debug("processing by autorun kernel");
+        return;
+    }
+
+    enqueue_kernel(dev, static_cast<Stream*>(ptr), load_kernel(dev, launch_params.file_name, launch_params.kernel_name), launch_params);
+}
+
+void* OpenCLPlatform::get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) {
+    return load_kernel(dev, file_name, kernel_name);
+}
+
+void OpenCLPlatform::launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) {
     if (devices_[dev].is_intel_fpga && launch_params.num_args == 0) {
         debug("processing by autorun kernel");
         return;
     }
 
-    auto kernel = load_kernel(dev, launch_params.file_name, launch_params.kernel_name);
+    enqueue_kernel(dev, nullptr, static_cast<cl_kernel>(kernel), launch_params);
+}
+
+void OpenCLPlatform::enqueue_kernel(DeviceId dev, Stream* stream, cl_kernel kernel, const LaunchParams& launch_params) {
     bool is_spirv = ends_with(launch_params.file_name, ".spv");
 
-    // set up arguments
+    // set up arguments, structures are copied on streams as the kernel may run after the call returns
     std::vector<cl_mem> kernel_structs;
     for (uint32_t i = 0; i < launch_params.num_args; i++) {
-        if (!is_spirv && launch_params.args.types[i] == KernelArgType::Struct) {
-            // create a buffer for each structure argument
-            cl_int err = CL_SUCCESS;
-            cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR;
-            cl_mem struct_buf = clCreateBuffer(devices_[dev].ctx, flags, launch_params.args.sizes[i], launch_params.args.data[i], &err);
-            CHECK_OPENCL(err, "clCreateBuffer()");
+        if (auto struct_buf = set_kernel_arg(dev, kernel, launch_params, i, is_spirv, stream != nullptr))
             kernel_structs.push_back(struct_buf);
-            clSetKernelArg(kernel, i, sizeof(cl_mem), &struct_buf);
-        } else {
-            #ifdef CL_VERSION_2_0
-            if (launch_params.args.types[i] == KernelArgType::Ptr && devices_[dev].version_major == 2) {
-                cl_int err = clSetKernelArgSVMPointer(kernel, i, *(void**)launch_params.args.data[i]);
-                CHECK_OPENCL(err, "clSetKernelArgSVMPointer()");
-                continue;
-            }
-            #endif
-            cl_int err = clSetKernelArg(kernel, i,
-                launch_params.args.types[i] == KernelArgType::Ptr ? sizeof(cl_mem) : launch_params.args.sizes[i],
-                launch_params.args.data[i]);
-            CHECK_OPENCL(err, "clSetKernelArg()");
-        }
     }
 
     size_t global_work_size[] = {launch_params.grid [0], launch_params.grid [1], launch_params.grid [2]};
@@ -403,27 +632,33 @@ void OpenCLPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_para
 
     // launch the kernel
     cl_event event = 0;
-    auto queue = devices_[dev].queue;
+    auto queue = stream ? stream->queue : devices_[dev].queue;
     if (devices_[dev].is_intel_fpga || devices_[dev].is_xilinx_fpga)
         queue = devices_[dev].kernels_queue[kernel];
+    cl_uint num_waits = stream ? stream->num_waits() : 0;
+    const cl_event* wait_list = stream ? stream->wait_list() : NULL;
 
     if (devices_[dev].is_xilinx_fpga && global_work_size[0] == 1 && global_work_size[1] == 1 && global_work_size[2] == 1) {
-        cl_int err = clEnqueueTask(queue, kernel, 0, NULL, &event);
+        cl_int err = clEnqueueTask(queue, kernel, num_waits, wait_list, &event);
         CHECK_OPENCL(err, "clEnqueueTask()");
     } else {
-        cl_int err = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global_work_size, local_work_size, 0, NULL, &event);
+        cl_int err = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global_work_size, local_work_size, num_waits, wait_list, &event);
         CHECK_OPENCL(err, "clEnqueueNDRangeKernel()");
     }
 
-    if (runtime_->profiling_enabled() && event) {
-        cl_int err = clSetEventCallback(event, CL_COMPLETE, &time_kernel_callback, &devices_[dev]);
-        devices_[dev].atomic_data.timings_counter.fetch_add(1);
-        CHECK_OPENCL(err, "clSetEventCallback()");
-    } else {
-        cl_int err = clReleaseEvent(event);
-        CHECK_OPENCL(err, "clReleaseEvent()");
+    if (stream) {
+        // The stream keeps its own reference to the event, for the next command to wait on
+        cl_int err = clRetainEvent(event);
+        CHECK_OPENCL(err, "clRetainEvent()");
+        if (queue != stream->queue) {
+            err = clFlush(queue);
+            CHECK_OPENCL(err, "clFlush()");
+        }
+        chain(*stream, event);
     }
 
+    time_kernel(dev, event);
+
     if (runtime_->dynamic_profiling_enabled())
         dynamic_profile(dev, launch_params.file_name);
 
@@ -434,7 +669,84 @@ void OpenCLPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_para
     }
 }
 
+void* OpenCLPlatform::record_launch(DeviceId dev, void* kernel, const LaunchParams& launch_params) {
+    if (devices_[dev].is_intel_fpga && launch_params.num_args == 0)
+        return nullptr;
+
+    // The recorded launch has a kernel object of its own, whose arguments stay set between replays
+    auto shared_kernel = static_cast<cl_kernel>(kernel);
+    cl_program program;
+    cl_int err = clGetKernelInfo(shared_kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, NULL);
+    CHECK_OPENCL(err, "clGetKernelInfo()");
+
+    auto launch = new RecordedLaunch;
+    launch->kernel = clCreateKernel(program, launch_params.kernel_name, &err);
+    CHECK_OPENCL(err, "clCreateKernel()");
+    launch->queue = devices_[dev].queue;
+    if (devices_[dev].is_intel_fpga || devices_[dev].is_xilinx_fpga)
+        launch->queue = devices_[dev].kernels_queue[shared_kernel];
+    launch->is_spirv = ends_with(launch_params.file_name, ".spv");
+    launch->is_task = devices_[dev].is_xilinx_fpga;
+    for (int i = 0; i < 3; ++i) {
+        launch->global_work_size[i] = launch_params.grid[i];
+        launch->local_work_size[i]  = launch_params.block[i];
+        launch->is_task &= launch_params.grid[i] == 1;
+    }
+    launch->structs.resize(launch_params.num_args, nullptr);
+    for (uint32_t i = 0; i < launch_params.num_args; i++)
+        launch->structs[i] = set_kernel_arg(dev, launch->kernel, launch_params, i, launch->is_spirv, true);
+    return launch;
+}
+
+void OpenCLPlatform::update_launch(DeviceId dev, void* ptr, const LaunchParams& launch_params, uint32_t arg) {
+    auto launch = static_cast<RecordedLaunch*>(ptr);
+    if (launch->structs[arg]) {
+        cl_int err = clReleaseMemObject(launch->structs[arg]);
+        CHECK_OPENCL(err, "clReleaseMemObject()");
+    }
+    launch->structs[arg] = set_kernel_arg(dev, launch->kernel, launch_params, arg, launch->is_spirv, true);
+}
+
+void OpenCLPlatform::replay_launch(DeviceId dev, void* ptr, const LaunchParams&) {
+    auto launch = static_cast<RecordedLaunch*>(ptr);
+    cl_event event = 0;
+    if (launch->is_task) {
+        cl_int err = clEnqueueTask(launch->queue, launch->kernel, 0, NULL, &event);
+        CHECK_OPENCL(err, "clEnqueueTask()");
+    } else {
+        cl_int err = clEnqueueNDRangeKernel(launch->queue, launch->kernel, 3, NULL, launch->global_work_size, launch->local_work_size, 0, NULL, &event);
+        CHECK_OPENCL(err, "clEnqueueNDRangeKernel()");
+    }
+    time_kernel(dev, event);
+}
+
+void OpenCLPlatform::release_launch(DeviceId, void* ptr) {
+    auto launch = static_cast<RecordedLaunch*>(ptr);
+    cl_int err = CL_SUCCESS;
+    for (auto struct_buf : launch->structs) {
+        if (struct_buf)
+            err |= clReleaseMemObject(struct_buf);
+    }
+    err |= clReleaseKernel(launch->kernel);
+    CHECK_OPENCL(err, "clReleaseKernel()");
+    delete launch;
+}
+
 void OpenCLPlatform::synchronize(DeviceId dev) {
+    // Streams are waited for as well, and their queues are kept alive while doing so
+    std::vector<cl_command_queue> stream_queues;
+    devices_[dev].lock();
+    for (auto stream : devices_[dev].streams) {
+        clRetainCommandQueue(stream->queue);
+        stream_queues.push_back(stream->queue);
+    }
+    devices_[dev].unlock();
+    for (auto queue : stream_queues) {
+        cl_int err = clFinish(queue);
+        err |= clReleaseCommandQueue(queue);
+        CHECK_OPENCL(err, "clFinish()");
+    }
+
     if (devices_[dev].is_intel_fpga || devices_[dev].is_xilinx_fpga) {
         auto& queue_map = devices_[dev].kernels_queue;
         for (auto& it : queue_map) {
@@ -450,6 +762,171 @@ void OpenCLPlatform::synchronize(DeviceId dev) {
     }
 }
 
+void* OpenCLPlatform::stream_create(DeviceId dev) {
+    // Unlike markers of the default queue, markers of streams are timed whether or not profiling is enabled
+    auto stream = new Stream;
+    stream->queue = create_queue(dev, true);
+    devices_[dev].lock();
+    devices_[dev].streams.insert(stream);
+    devices_[dev].unlock();
+    return stream;
+}
+
+void OpenCLPlatform::stream_destroy(DeviceId dev, void* ptr) {
+    auto stream = static_cast<Stream*>(ptr);
+    stream_synchronize(dev, stream);
+    devices_[dev].lock();
+    devices_[dev].streams.erase(stream);
+    devices_[dev].unlock();
+    cl_int err = CL_SUCCESS;
+    if (stream->last)
+        err |= clReleaseEvent(stream->last);
+    err |= clReleaseCommandQueue(stream->queue);
+    CHECK_OPENCL(err, "clReleaseCommandQueue()");
+    delete stream;
+}
+
+void OpenCLPlatform::stream_synchronize(DeviceId, void* ptr) {
+    // The last command of the stream completes after all the others
+    auto stream = static_cast<Stream*>(ptr);
+    if (!stream->last)
+        return;
+    cl_int err = clWaitForEvents(1, &stream->last);
+    CHECK_OPENCL(err, "clWaitForEvents()");
+}
+
+void OpenCLPlatform::chain(Stream& stream, cl_event event) {
+    cl_int err = CL_SUCCESS;
+    if (stream.last)
+        err |= clReleaseEvent(stream.last);
+    stream.last = event;
+    // Without a flush, commands of other queues that wait for this one could wait forever
+    err |= clFlush(stream.queue);
+    CHECK_OPENCL(err, "clFlush()");
+}
+
+void OpenCLPlatform::event_destroy(DeviceId, void* ptr) {
+    auto event = static_cast<Event*>(ptr);
+    if (event->marker) {
+        cl_int err = clReleaseEvent(event->marker);
+        CHECK_OPENCL(err, "clReleaseEvent()");
+    }
+    delete event;
+}
+
+void OpenCLPlatform::event_record(DeviceId dev, void* stream_ptr, void* ptr) {
+    auto stream = static_cast<Stream*>(stream_ptr);
+    auto event = static_cast<Event*>(ptr);
+    cl_event marker = nullptr;
+    cl_int err = CL_SUCCESS;
+    if (stream) {
+        err = clEnqueueMarkerWithWaitList(stream->queue, stream->num_waits(), stream->wait_list(), &marker);
+    } else {
+        // FPGA kernels launched without a stream are not on the default queue
+        if (devices_[dev].is_intel_fpga || devices_[dev].is_xilinx_fpga)
+            synchronize(dev);
+        err = clEnqueueMarkerWithWaitList(devices_[dev].queue, 0, NULL, &marker);
+    }
+    CHECK_OPENCL(err, "clEnqueueMarkerWithWaitList()");
+    if (event->marker)
+        err |= clReleaseEvent(event->marker);
+    err |= clFlush(stream ? stream->queue : devices_[dev].queue);
+    CHECK_OPENCL(err, "clFlush()");
+    event->marker = marker;
+    event->timed = stream || runtime_->profiling_enabled();
+}
+
+void OpenCLPlatform::event_wait(DeviceId dev, void* stream_ptr, void* ptr) {
+    auto stream = static_cast<Stream*>(stream_ptr);
+    auto event = static_cast<Event*>(ptr);
+    if (!event->marker)
+        return;
+    cl_int err = CL_SUCCESS;
+    if (stream) {
+        // The next command of the stream waits for a marker of both the event and the previous command
+        cl_event wait_list[] = { event->marker, stream->last };
+        cl_event marker = nullptr;
+        err = clEnqueueMarkerWithWaitList(stream->queue, stream->last ? 2 : 1, wait_list, &marker);
+        CHECK_OPENCL(err, "clEnqueueMarkerWithWaitList()");
+        return chain(*stream, marker);
+    }
+    err = clEnqueueBarrierWithWaitList(devices_[dev].queue, 1, &event->marker, NULL);
+    CHECK_OPENCL(err, "clEnqueueBarrierWithWaitList()");
+}
+
+bool OpenCLPlatform::event_query(DeviceId, void* ptr) {
+    auto event = static_cast<Event*>(ptr);
+    if (!event->marker)
+        return true;
+    cl_int status = CL_COMPLETE;
+    cl_int err = clGetEventInfo(event->marker, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+    CHECK_OPENCL(err, "clGetEventInfo()");
+    // Failed commands have a negative status
+    if (status < 0)
+        CHECK_OPENCL(status, "Event status: clGetEventInfo()");
+    return status == CL_COMPLETE;
+}
+
+void OpenCLPlatform::event_synchronize(DeviceId, void* ptr) {
+    auto event = static_cast<Event*>(ptr);
+    if (!event->marker)
+        return;
+    cl_int err = clWaitForEvents(1, &event->marker);
+    CHECK_OPENCL(err, "clWaitForEvents()");
+}
+
+int64_t OpenCLPlatform::event_elapsed(DeviceId dev, void* start_ptr, void* end_ptr) {
+    auto start = static_cast<Event*>(start_ptr);
+    auto end = static_cast<Event*>(end_ptr);
+    if (!start->marker || !end->marker)
+        error("Cannot measure the time between events that have not been recorded");
+    // Markers on the default queue are only timed when profiling is enabled
+    if (!start->timed || !end->timed)
+        error("Cannot measure the time between events recorded without a stream when profiling is disabled");
+    event_synchronize(dev, start);
+    event_synchronize(dev, end);
+    cl_ulong start_time, end_time;
+    cl_int err = clGetEventProfilingInfo(start->marker, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &start_time, NULL);
+    err |= clGetEventProfilingInfo(end->marker, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
+    CHECK_OPENCL(err, "clGetEventProfilingInfo()");
+    return int64_t(end_time) - int64_t(start_time);
+}
+
+void OpenCLPlatform::copy_async(DeviceId dev, void* ptr, CopyKind kind, const CopyRegion& region) {
+    auto& stream = *static_cast<Stream*>(ptr);
+    auto src = static_cast<const char*>(region.src);
+    auto dst = static_cast<char*>(region.dst);
+    cl_event event = nullptr;
+    cl_int err = CL_SUCCESS;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2) {
+        err = clEnqueueSVMMemcpy(stream.queue, CL_FALSE, dst + region.offset_dst, src + region.offset_src, region.size,
+            stream.num_waits(), stream.wait_list(), &event);
+        CHECK_OPENCL(err, "clEnqueueSVMMemcpy()");
+        return chain(stream, event);
+    }
+    #endif
+    unused(dev);
+    switch (kind) {
+        case CopyKind::DeviceToDevice:
+            err = clEnqueueCopyBuffer(stream.queue, (cl_mem)src, (cl_mem)dst, region.offset_src, region.offset_dst, region.size,
+                stream.num_waits(), stream.wait_list(), &event);
+            CHECK_OPENCL(err, "clEnqueueCopyBuffer()");
+            break;
+        case CopyKind::HostToDevice:
+            err = clEnqueueWriteBuffer(stream.queue, (cl_mem)dst, CL_FALSE, region.offset_dst, region.size, src + region.offset_src,
+                stream.num_waits(), stream.wait_list(), &event);
+            CHECK_OPENCL(err, "clEnqueueWriteBuffer()");
+            break;
+        case CopyKind::DeviceToHost:
+            err = clEnqueueReadBuffer(stream.queue, (cl_mem)src, CL_FALSE, region.offset_src, region.size, dst + region.offset_dst,
+                stream.num_waits(), stream.wait_list(), &event);
+            CHECK_OPENCL(err, "clEnqueueReadBuffer()");
+            break;
+    }
+    chain(stream, event);
+}
+
 void OpenCLPlatform::copy(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
     assert(dev_src == dev_dst);
     unused(dev_dst);
@@ -467,6 +944,100 @@ void OpenCLPlatform::copy(DeviceId dev_src, const void* src, int64_t offset_src,
     CHECK_OPENCL(err, "clEnqueueCopyBuffer()");
 }
 
+void* OpenCLPlatform::alloc_pitched(DeviceId dev, int64_t width, int64_t height, int64_t depth, int64_t& pitch) {
+    // Align rows to the base address alignment of the device, which is given in bits
+    cl_uint align_bits = 0;
+    cl_int err = clGetDeviceInfo(devices_[dev].dev, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, NULL);
+    CHECK_OPENCL(err, "clGetDeviceInfo()");
+    int64_t row_alignment = std::max(int64_t(align_bits / 8), int64_t(1));
+    pitch = (width + row_alignment - 1) / row_alignment * row_alignment;
+    return alloc(dev, pitch * height * depth);
+}
+
+void OpenCLPlatform::copy_3d(CopyKind kind, DeviceId dev_src, const void* src, Pitch src_pitch, DeviceId dev_dst, void* dst, Pitch dst_pitch, const Region3D& region) {
+    DeviceId dev = kind == CopyKind::HostToDevice ? dev_dst : dev_src;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return Platform::copy_3d(kind, dev_src, src, src_pitch, dev_dst, dst, dst_pitch, region);
+    #endif
+    if (kind == CopyKind::DeviceToDevice && dev_src != dev_dst)
+        return Platform::copy_3d(kind, dev_src, src, src_pitch, dev_dst, dst, dst_pitch, region);
+
+    const size_t src_origin[3] = { size_t(region.src_x), size_t(region.src_y), size_t(region.src_z) };
+    const size_t dst_origin[3] = { size_t(region.dst_x), size_t(region.dst_y), size_t(region.dst_z) };
+    const size_t box[3] = { size_t(region.width), size_t(region.height), size_t(region.depth) };
+    auto queue = devices_[dev].queue;
+    cl_int err = CL_SUCCESS;
+    switch (kind) {
+        case CopyKind::DeviceToDevice:
+            err = clEnqueueCopyBufferRect(queue, (cl_mem)src, (cl_mem)dst, src_origin, dst_origin, box,
+                src_pitch.row, src_pitch.slice, dst_pitch.row, dst_pitch.slice, 0, NULL, NULL);
+            CHECK_OPENCL(err, "clEnqueueCopyBufferRect()");
+            break;
+        case CopyKind::HostToDevice:
+            // The box is located in host memory with the host origin and pitches
+            err = clEnqueueWriteBufferRect(queue, (cl_mem)dst, CL_FALSE, dst_origin, src_origin, box,
+                dst_pitch.row, dst_pitch.slice, src_pitch.row, src_pitch.slice, src, 0, NULL, NULL);
+            CHECK_OPENCL(err, "clEnqueueWriteBufferRect()");
+            break;
+        case CopyKind::DeviceToHost:
+            err = clEnqueueReadBufferRect(queue, (cl_mem)src, CL_FALSE, src_origin, dst_origin, box,
+                src_pitch.row, src_pitch.slice, dst_pitch.row, dst_pitch.slice, dst, 0, NULL, NULL);
+            CHECK_OPENCL(err, "clEnqueueReadBufferRect()");
+            break;
+    }
+    err = clFinish(queue);
+    CHECK_OPENCL(err, "clFinish()");
+}
+
+void OpenCLPlatform::copy_batch(CopyKind kind, DeviceId dev_src, DeviceId dev_dst, const CopyRegion* regions, size_t count) {
+    DeviceId dev = kind == CopyKind::HostToDevice ? dev_dst : dev_src;
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2)
+        return Platform::copy_batch(kind, dev_src, dev_dst, regions, count);
+    #endif
+    if (kind == CopyKind::DeviceToDevice && dev_src != dev_dst)
+        return Platform::copy_batch(kind, dev_src, dev_dst, regions, count);
+
+    // All the commands are enqueued without blocking, and the queue is drained once
+    cl_int err = CL_SUCCESS;
+    auto queue = devices_[dev].queue;
+    for (size_t i = 0; i < count; ++i) {
+        auto& region = regions[i];
+        switch (kind) {
+            case CopyKind::DeviceToDevice:
+                err |= clEnqueueCopyBuffer(queue, (cl_mem)region.src, (cl_mem)region.dst, region.offset_src, region.offset_dst, region.size, 0, NULL, NULL);
+                break;
+            case CopyKind::HostToDevice:
+                err |= clEnqueueWriteBuffer(queue, (cl_mem)region.dst, CL_FALSE, region.offset_dst, region.size, (char*)region.src + region.offset_src, 0, NULL, NULL);
+                break;
+            case CopyKind::DeviceToHost:
+                err |= clEnqueueReadBuffer(queue, (cl_mem)region.src, CL_FALSE, region.offset_src, region.size, (char*)region.dst + region.offset_dst, 0, NULL, NULL);
+                break;
+        }
+    }
+    err |= clFinish(queue);
+    CHECK_OPENCL(err, "copy_batch()");
+}
+
+void OpenCLPlatform::memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) {
+    #ifdef CL_VERSION_2_0
+    if (devices_[dev].version_major == 2) {
+        cl_int err = clEnqueueSVMMemFill(devices_[dev].queue, (char*)ptr + offset, pattern, pattern_size, size, 0, NULL, NULL);
+        err |= clFinish(devices_[dev].queue);
+        CHECK_OPENCL(err, "clEnqueueSVMMemFill()");
+        return;
+    }
+    #endif
+    #ifdef CL_VERSION_1_2
+    cl_int err = clEnqueueFillBuffer(devices_[dev].queue, (cl_mem)ptr, pattern, pattern_size, offset, size, 0, NULL, NULL);
+    err |= clFinish(devices_[dev].queue);
+    CHECK_OPENCL(err, "clEnqueueFillBuffer()");
+    #else
+    Platform::memset(dev, ptr, offset, pattern, pattern_size, size);
+    #endif
+}
+
 void OpenCLPlatform::copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
     #ifdef CL_VERSION_2_0
     if (devices_[dev_dst].version_major == 2)
@@ -596,9 +1167,13 @@ void OpenCLPlatform::dynamic_profile(DeviceId dev, const std::string& filename)
         error("Dynamic Profiling is not available for this platform");
 }
 
-cl_kernel OpenCLPlatform::load_kernel(DeviceId dev, const std::string& filename, const std::string& kernelname) {
+cl_kernel OpenCLPlatform::load_kernel(DeviceId dev, std::string_view file_name, std::string_view kernel_name) {
     auto& opencl_dev = devices_[dev];
 
+    if (auto kernel = opencl_dev.loaded.find(file_name, kernel_name))
+        return *kernel;
+    std::string filename(file_name), kernelname(kernel_name);
+
     opencl_dev.lock();
 
     cl_int err = CL_SUCCESS;
@@ -606,7 +1181,16 @@ cl_kernel OpenCLPlatform::load_kernel(DeviceId dev, const std::string& filename,
     auto canonical = std::filesystem::weakly_canonical(filename);
     auto& prog_cache = opencl_dev.programs;
     auto prog_it = prog_cache.find(canonical.string());
-    if (prog_it == prog_cache.end()) {
+    auto compiling_it = opencl_dev.compiling.find(canonical.string());
+    if (prog_it == prog_cache.end() && compiling_it != opencl_dev.compiling.end()) {
+        // another thread compiles the program, wait for it instead of compiling it again
+        auto compiled = compiling_it->second;
+        opencl_dev.unlock();
+        program = compiled.get();
+        opencl_dev.lock();
+    } else if (prog_it == prog_cache.end()) {
+        std::promise<cl_program> compiled;
+        opencl_dev.compiling.emplace(canonical.string(), compiled.get_future().share());
         opencl_dev.unlock();
 
         // load file from disk or cache
@@ -634,6 +1218,8 @@ cl_kernel OpenCLPlatform::load_kernel(DeviceId dev, const std::string& filename,
 
         opencl_dev.lock();
         prog_cache[canonical.string()] = program;
+        opencl_dev.compiling.erase(canonical.string());
+        compiled.set_value(program);
     } else {
         program = prog_it->second;
     }
@@ -664,7 +1250,7 @@ cl_kernel OpenCLPlatform::load_kernel(DeviceId dev, const std::string& filename,
 
     opencl_dev.unlock();
 
-    return kernel;
+    return opencl_dev.loaded.insert(filename, canonical.string(), kernelname, kernel);
 }
 
 const char* OpenCLPlatform::device_name(DeviceId dev) const {
@@ -2,10 +2,13 @@
 #define OPENCL_PLATFORM_H
 
 #include "platform.h"
+#include "loaded_kernels.h"
 
 #include <atomic>
+#include <future>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #ifdef __APPLE__
@@ -25,18 +28,91 @@ public:
 
 protected:
     void* alloc(DeviceId dev, int64_t size) override;
-    void* alloc_host(DeviceId, int64_t) override { command_unavailable("alloc_host"); }
+    void* try_alloc(DeviceId dev, int64_t size) override;
+    void release_deferred(DeviceId dev, void* ptr) override;
+    void* alloc_ex(DeviceId dev, int64_t size, const AllocProps& props) override;
+    void* alloc_host(DeviceId dev, int64_t size) override;
     void* alloc_unified(DeviceId, int64_t) override;
-    void* get_device_ptr(DeviceId, void*) override { command_unavailable("get_device_ptr"); }
+    void* get_device_ptr(DeviceId dev, void* ptr) override;
     void release(DeviceId dev, void* ptr) override;
-    void release_host(DeviceId, void*) override { command_unavailable("release_host"); }
-
-    void launch_kernel(DeviceId dev, const LaunchParams& launch_params) override;
+    void release_host(DeviceId dev, void* ptr) override;
+    bool host_register(DeviceId dev, void* ptr, int64_t size, int32_t flags) override;
+    void host_unregister(DeviceId dev, void* ptr) override;
+    bool has_pinned_host_memory(DeviceId dev) const override { return devices_[dev].version_major != 2; }
+    bool has_addressable_memory(DeviceId dev) const override;
+    void mem_advise(DeviceId dev, void* ptr, int64_t size, MemAdvice advice) override;
+    void mem_prefetch(DeviceId dev, void* ptr, int64_t size) override;
+    void migrate(DeviceId dev, void* ptr, int64_t size, bool to_host);
+
+    void launch_kernel(DeviceId dev, const LaunchParams& launch_params) override { launch_kernel_on(dev, nullptr, launch_params); }
+    void* get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) override;
+    void launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) override;
     void synchronize(DeviceId dev) override;
+    /// Sets an argument of the kernel, and returns the buffer created for it if it is a structure.
+    cl_mem set_kernel_arg(DeviceId dev, cl_kernel kernel, const LaunchParams& launch_params, uint32_t i, bool is_spirv, bool copy_struct);
+    /// Accounts for the kernel time when profiling is enabled, and releases the event of the launch.
+    void time_kernel(DeviceId dev, cl_event event);
+
+    /// A launch prepared for replays, with a kernel object of its own whose arguments are already set.
+    struct RecordedLaunch {
+        cl_kernel kernel;
+        cl_command_queue queue;
+        size_t global_work_size[3];
+        size_t local_work_size[3];
+        bool is_spirv;
+        bool is_task;
+        /// Buffers created for structure arguments, or `nullptr` for other arguments.
+        std::vector<cl_mem> structs;
+    };
+
+    void* record_launch(DeviceId dev, void* kernel, const LaunchParams& launch_params) override;
+    void update_launch(DeviceId dev, void* launch, const LaunchParams& launch_params, uint32_t arg) override;
+    void replay_launch(DeviceId dev, void* launch, const LaunchParams& launch_params) override;
+    void release_launch(DeviceId dev, void* launch) override;
+
+    /// A stream with a command queue of its own. Each command waits for the event of the previous one,
+    /// which keeps the stream in order when FPGA kernels run on their own queues.
+    struct Stream {
+        cl_command_queue queue;
+        cl_event last = nullptr;
+
+        cl_uint num_waits() const { return last ? 1 : 0; }
+        const cl_event* wait_list() const { return last ? &last : nullptr; }
+    };
+
+    void* stream_create(DeviceId dev) override;
+    void stream_destroy(DeviceId dev, void* stream) override;
+    void stream_synchronize(DeviceId dev, void* stream) override;
+    void copy_async(DeviceId dev, void* stream, CopyKind kind, const CopyRegion& region) override;
+    void launch_kernel_on(DeviceId dev, void* stream, const LaunchParams& launch_params) override;
+    /// Sets the arguments of a loaded kernel, and enqueues it on the stream, or on the device queue if it is `nullptr`.
+    void enqueue_kernel(DeviceId dev, Stream* stream, cl_kernel kernel, const LaunchParams& launch_params);
+    /// Makes the given event the last one of the stream, and submits the stream queue to the device.
+    void chain(Stream& stream, cl_event event);
+    cl_command_queue create_queue(DeviceId dev, bool profiling);
+
+    /// An event of an OpenCL device, which holds the marker enqueued by its last recording.
+    struct Event {
+        cl_event marker = nullptr;
+        /// Whether the marker is on a queue with profiling enabled.
+        bool timed = false;
+    };
+
+    void* event_create(DeviceId) override { return new Event; }
+    void event_destroy(DeviceId dev, void* event) override;
+    void event_record(DeviceId dev, void* stream, void* event) override;
+    void event_wait(DeviceId dev, void* stream, void* event) override;
+    bool event_query(DeviceId dev, void* event) override;
+    void event_synchronize(DeviceId dev, void* event) override;
+    int64_t event_elapsed(DeviceId dev, void* start, void* end) override;
 
     void copy(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override;
     void copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) override;
     void copy_to_host(DeviceId dev_src, const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size) override;
+    void* alloc_pitched(DeviceId dev, int64_t width, int64_t height, int64_t depth, int64_t& pitch) override;
+    void copy_3d(CopyKind kind, DeviceId dev_src, const void* src, Pitch src_pitch, DeviceId dev_dst, void* dst, Pitch dst_pitch, const Region3D& region) override;
+    void copy_batch(CopyKind kind, DeviceId dev_src, DeviceId dev_dst, const CopyRegion* regions, size_t count) override;
+    void memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) override;
     void copy_svm(const void* src, int64_t offset_src, void* dst, int64_t offset_dst, int64_t size);
     void dynamic_profile(DeviceId dev, const std::string& filename);
 
@@ -64,8 +140,15 @@ protected:
         bool is_xilinx_fpga = false;
 
         std::unordered_map<std::string, cl_program> programs;
+        /// Programs being compiled, which other threads loading the same file wait for.
+        std::unordered_map<std::string, std::shared_future<cl_program>> compiling;
         std::unordered_map<cl_program, KernelMap> kernels;
         std::unordered_map<cl_kernel, cl_command_queue> kernels_queue;
+        /// Kernels returned by `load_kernel()`, by file and kernel name, which launches look up without taking the device lock.
+        LoadedKernels<cl_kernel> loaded;
+        std::unordered_map<void*, cl_mem> host_buffers;
+        std::unordered_map<void*, cl_mem> registered_buffers;
+        std::unordered_set<Stream*> streams;
 
         // Atomics do not have a move constructor. This structure introduces one.
         struct AtomicData {
@@ -105,7 +188,7 @@ protected:
 
     std::vector<DeviceData> devices_;
 
-    cl_kernel load_kernel(DeviceId dev, const std::string& filename, const std::string& kernelname);
+    cl_kernel load_kernel(DeviceId dev, std::string_view file_name, std::string_view kernel_name);
     cl_program load_program_binary(DeviceId dev, const std::string& filename, const std::string& program_string) const;
     cl_program load_program_il(DeviceId dev, const std::string& filename, const std::string& program_string) const;
     cl_program load_program_source(DeviceId dev, const std::string& filename, const std::string& program_string) const;
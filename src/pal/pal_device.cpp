@@ -371,7 +371,7 @@ void PalDevice::copy_gpu_data(
 
 void PalDevice::dispatch(const Pal::CmdBufferBuildInfo& cmd_buffer_build_info,
     const Pal::PipelineBindParams& pipeline_bind_params, const Pal::BarrierInfo& barrier_info,
-    const LaunchParams& launch_params) {
+    const LaunchParams& launch_params, const ArgLayout* layout, const void* packed_args) {
     // Make sure we can cast to uint16_t
     assert(launch_params.block[0] <= 65535);
     assert(launch_params.block[1] <= 65535);
@@ -398,7 +398,7 @@ void PalDevice::dispatch(const Pal::CmdBufferBuildInfo& cmd_buffer_build_info,
     const bool are_params_present = launch_params.num_args > 0;
     if (are_params_present) {
         GpuVirtAddr_t kernargs_buffer =
-            build_kernargs_buffer(launch_params.args, launch_params.num_args, launch_params.kernel_name);
+            build_kernargs_buffer(launch_params.args, launch_params.num_args, launch_params.kernel_name, layout, packed_args);
         assert(kernargs_buffer && "Kernargs buffer could not be built for launch param arguments.");
 
         std::memcpy(&pal_user_data.buffer_vaddr, &kernargs_buffer, sizeof(uint64_t));
@@ -517,10 +517,17 @@ size_t PalDevice::write_launch_params(const ParamsArgs& params_args, uint32_t nu
 }
 
 PalDevice::GpuVirtAddr_t PalDevice::build_kernargs_buffer(
-    const ParamsArgs& params_args, int num_args, const char* kernel_name) {
+    const ParamsArgs& params_args, int num_args, const char* kernel_name, const ArgLayout* layout, const void* packed_args) {
     if (num_args == 0)
         return nulladdr;
 
+    // Packed arguments follow the same layout as the kernarg segment
+    if (packed_args) {
+        return write_data_to_gpu(layout->size, [&](void* dest_mem) {
+            std::memcpy(dest_mem, packed_args, layout->size);
+        });
+    }
+
     uint32_t kernarg_segment_size = calculate_launch_params_size(params_args, num_args);
 
     size_t used_memory;
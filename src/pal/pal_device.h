@@ -73,7 +73,7 @@ public:
 
     void dispatch(const Pal::CmdBufferBuildInfo& cmd_buffer_build_info,
         const Pal::PipelineBindParams& pipeline_bind_params, const Pal::BarrierInfo& barrier_info,
-        const LaunchParams& launch_params);
+        const LaunchParams& launch_params, const ArgLayout* layout = nullptr, const void* packed_args = nullptr);
 
     void WaitIdle();
 
@@ -102,8 +102,9 @@ private:
     }
 
     // Build a buffer holding the kernel arguments and upload to the GPU.
-    // Returns the address of the buffer on the gpu.
-    GpuVirtAddr_t build_kernargs_buffer(const ParamsArgs& params_args, int num_args, const char* kernel_name);
+    // Packed arguments, if given, are uploaded as they are. Returns the address of the buffer on the gpu.
+    GpuVirtAddr_t build_kernargs_buffer(const ParamsArgs& params_args, int num_args, const char* kernel_name,
+        const ArgLayout* layout, const void* packed_args);
 
     // Helper function that allocates a gpu-only buffer of the given size and uploads the data written by the
     // write_callback
@@ -206,7 +206,22 @@ void PALPlatform::release_host(DeviceId, void* ptr) {
 }
 
 void PALPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params) {
-    Pal::IPipeline* pipeline = load_kernel(dev, launch_params.file_name, launch_params.kernel_name);
+    dispatch_pipeline(dev, load_kernel(dev, launch_params.file_name, launch_params.kernel_name), launch_params);
+}
+
+void* PALPlatform::get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) {
+    return load_kernel(dev, file_name, kernel_name);
+}
+
+void PALPlatform::launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) {
+    dispatch_pipeline(dev, static_cast<Pal::IPipeline*>(kernel), launch_params);
+}
+
+void PALPlatform::launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) {
+    dispatch_pipeline(dev, static_cast<Pal::IPipeline*>(kernel), launch_params, &layout, args);
+}
+
+void PALPlatform::dispatch_pipeline(DeviceId dev, Pal::IPipeline* pipeline, const LaunchParams& launch_params, const ArgLayout* layout, const void* packed_args) {
 
     Pal::CmdBufferBuildInfo cmd_buffer_build_info = {};
     cmd_buffer_build_info.flags.optimizeExclusiveSubmit = 1;
@@ -224,7 +239,7 @@ void PALPlatform::launch_kernel(DeviceId dev, const LaunchParams& launch_params)
     barrier_info.globalDstCacheMask = Pal::CoherShader;
 
     auto& device = devices_[dev];
-    device.dispatch(cmd_buffer_build_info, params, barrier_info, launch_params);
+    device.dispatch(cmd_buffer_build_info, params, barrier_info, launch_params, layout, packed_args);
 }
 
 void PALPlatform::synchronize(DeviceId dev) {
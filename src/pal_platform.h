@@ -32,10 +32,15 @@ protected:
     void* alloc_host(DeviceId dev, int64_t size) override;
     void* alloc_unified(DeviceId dev, int64_t size) override;
     void* get_device_ptr(DeviceId, void*) override { command_unavailable("get_device_ptr"); }
+    /// Memory objects are looked up by the exact address of their allocation.
+    bool has_addressable_memory(DeviceId) const override { return false; }
     void release(DeviceId dev, void* ptr) override;
     void release_host(DeviceId dev, void* ptr) override;
 
     void launch_kernel(DeviceId dev, const LaunchParams& launch_params) override;
+    void* get_kernel(DeviceId dev, const char* file_name, const char* kernel_name) override;
+    void launch_kernel_handle(DeviceId dev, void* kernel, const LaunchParams& launch_params) override;
+    void launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout& layout, const void* args, const LaunchParams& launch_params) override;
 
     void synchronize(DeviceId dev) override;
 
@@ -52,6 +57,7 @@ protected:
     bool device_check_feature_support(DeviceId, const char*) const override { return false; }
 
     Pal::IPipeline* load_kernel(DeviceId dev, const std::string& filename, const std::string& kernelname);
+    void dispatch_pipeline(DeviceId dev, Pal::IPipeline* pipeline, const LaunchParams& launch_params, const ArgLayout* = nullptr, const void* = nullptr);
     std::string compile_gcn(DeviceId dev, pal_utils::ShaderSrc&& shader_src) const;
     std::string emit_gcn(pal_utils::ShaderSrc&& shader_src, const std::string& cpu,
         Pal::GfxIpLevel gfx_level, llvm::OptimizationLevel opt) const;
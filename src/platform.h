@@ -5,8 +5,11 @@
 #include "log.h"
 #include "runtime.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 void register_cpu_platform(Runtime*);
 void register_cuda_platform(Runtime*);
@@ -27,6 +30,52 @@ public:
 
     /// Allocates memory for a device on this platform.
     virtual void* alloc(DeviceId dev, int64_t size) = 0;
+    /// Allocates memory for a device on this platform, returning `nullptr` instead of aborting when the device is out of memory.
+    /// By default, allocation failures abort as with `alloc()`.
+    virtual void* try_alloc(DeviceId dev, int64_t size) { return alloc(dev, size); }
+    /// Allocates memory for a device on this platform, honoring the given properties when the platform supports them.
+    /// By default, only zero-initialization is honored, with `memset()`.
+    virtual void* alloc_ex(DeviceId dev, int64_t size, const AllocProps& props) {
+        void* ptr = alloc(dev, size);
+        if (ptr && (props.flags & AllocProps::ZeroInit)) {
+            const char zero = 0;
+            memset(dev, ptr, 0, &zero, 1, size);
+        }
+        return ptr;
+    }
+    /// Returns a copy of a memory range, which is released with `release()`. By default, the range is copied immediately.
+    virtual void* snapshot(DeviceId dev, const void* ptr, int64_t size) {
+        void* copy = alloc(dev, size);
+        this->copy(dev, ptr, 0, dev, copy, 0, size);
+        return copy;
+    }
+    /// Reserves room for a buffer of up to `max_size` bytes, which is backed by memory as it is committed.
+    /// By default, the whole buffer is allocated upfront, and committing memory has no effect.
+    virtual void* alloc_reserve(DeviceId dev, int64_t max_size) { return alloc(dev, max_size); }
+    /// Backs the first `size` bytes of a reserved buffer with memory, without moving it.
+    virtual void commit(DeviceId, void*, int64_t) {}
+    /// Frees the memory backing a reserved buffer past its first `size` bytes.
+    virtual void decommit(DeviceId, void*, int64_t) {}
+    /// Resizes a buffer, and returns its new address. By default, the buffer is moved to a new allocation.
+    virtual void* realloc(DeviceId dev, void* ptr, int64_t old_size, int64_t new_size) {
+        void* new_ptr = alloc(dev, new_size);
+        if (ptr && new_ptr) {
+            copy(dev, ptr, 0, dev, new_ptr, 0, std::min(old_size, new_size));
+            release(dev, ptr);
+        }
+        return new_ptr;
+    }
+    /// Creates a named memory object of the given size that other processes can map with `open_shared()`.
+    /// Only supported by the host platform, which honors `AllocProps::HugePages` in the flags.
+    virtual void* alloc_shared(DeviceId, const char*, int64_t, int32_t) {
+        error("Shared memory is not supported on platform %", name());
+        return nullptr;
+    }
+    /// Maps a memory object created by `alloc_shared()`, and returns its size.
+    virtual void* open_shared(DeviceId, const char*, int64_t&) {
+        error("Shared memory is not supported on platform %", name());
+        return nullptr;
+    }
     /// Allocates page-locked host memory for a platform (and a device).
     virtual void* alloc_host(DeviceId dev, int64_t size) = 0;
     /// Allocates unified memory for a platform (and a device).
@@ -35,16 +84,114 @@ public:
     virtual void* get_device_ptr(DeviceId dev, void* ptr) = 0;
     /// Releases memory for a device on this platform.
     virtual void release(DeviceId dev, void* ptr) = 0;
+    /// Releases memory once the work submitted to the device before the call has completed. By default, the device is synchronized first.
+    virtual void release_deferred(DeviceId dev, void* ptr) {
+        synchronize(dev);
+        release(dev, ptr);
+    }
     /// Releases page-locked host memory for a device on this platform.
     virtual void release_host(DeviceId dev, void* ptr) = 0;
+    /// Page-locks existing host memory and makes it accessible through `get_device_ptr()`. Returns false if this is not supported.
+    virtual bool host_register(DeviceId, void*, int64_t, int32_t) { return false; }
+    /// Unregisters host memory registered with `host_register()`.
+    virtual void host_unregister(DeviceId, void*) {}
+    /// Returns whether `alloc_host()` returns page-locked memory that transfers to and from the device faster than pageable memory.
+    virtual bool has_pinned_host_memory(DeviceId) const { return false; }
+    /// Returns whether device allocations are addresses that can be offset, rather than opaque handles of memory objects.
+    virtual bool has_addressable_memory(DeviceId) const { return true; }
+
+    /// Gives a hint on how a memory range will be accessed. Hints that the platform cannot honor are ignored.
+    virtual void mem_advise(DeviceId, void*, int64_t, MemAdvice) {}
+    /// Starts migrating a memory range to the device, without waiting for completion.
+    virtual void mem_prefetch(DeviceId, void*, int64_t) {}
 
     /// Launches a kernel with the given block/grid size and arguments.
     virtual void launch_kernel(DeviceId dev, const LaunchParams& launch_params) = 0;
+    /// Loads a kernel and returns a handle to it, which stays valid as long as the platform. By default, kernels are launched by name.
+    virtual void* get_kernel(DeviceId, const char*, const char*) { return nullptr; }
+    /// Launches a kernel returned by `get_kernel()`, without looking it up by name.
+    virtual void launch_kernel_handle(DeviceId dev, void*, const LaunchParams& launch_params) { launch_kernel(dev, launch_params); }
+    /// Launches a kernel returned by `get_kernel()`, with its arguments packed in one buffer following the given layout.
+    /// The launch parameters hold pointers into that buffer, for platforms that set arguments one by one.
+    virtual void launch_kernel_packed(DeviceId dev, void* kernel, const ArgLayout&, const void*, const LaunchParams& launch_params) {
+        launch_kernel_handle(dev, kernel, launch_params);
+    }
     /// Waits for the completion of all the launched kernels on the given device.
     virtual void synchronize(DeviceId dev) = 0;
 
-    /// Copies memory. Copy can only be performed devices in the same platform.
+    /// Creates a queue whose commands run in order, asynchronously with the host and with other queues.
+    /// By default, devices only have one queue, which is represented by `nullptr` and whose commands are synchronous.
+    virtual void* stream_create(DeviceId) { return nullptr; }
+    /// Destroys a queue created by `stream_create()`, after waiting for its commands.
+    virtual void stream_destroy(DeviceId, void*) {}
+    /// Waits for the completion of the commands of a queue.
+    virtual void stream_synchronize(DeviceId dev, void*) { synchronize(dev); }
+    /// Enqueues a copy from, to, or within the device on a queue. Host memory is accessed until the queue is synchronized.
+    virtual void copy_async(DeviceId dev, void*, CopyKind kind, const CopyRegion& region) { copy_batch(kind, dev, dev, &region, 1); }
+    /// Enqueues a kernel launch on a queue.
+    virtual void launch_kernel_on(DeviceId dev, void*, const LaunchParams& launch_params) { launch_kernel(dev, launch_params); }
+
+    /// Prepares a launch of a kernel returned by `get_kernel()` to be replayed, and returns an object for it, or `nullptr` if replays are plain launches.
+    /// The kernel is `nullptr` on platforms that launch kernels by name.
+    virtual void* record_launch(DeviceId, void*, const LaunchParams&) { return nullptr; }
+    /// Replaces an argument of a launch returned by `record_launch()`, whose new value is in the given parameters.
+    virtual void update_launch(DeviceId, void*, const LaunchParams&, uint32_t) {}
+    /// Replays a launch returned by `record_launch()`, whose parameters are given again.
+    virtual void replay_launch(DeviceId dev, void*, const LaunchParams& launch_params) { launch_kernel(dev, launch_params); }
+    virtual void release_launch(DeviceId, void*) {}
+
+    /// Creates an event that marks a point in a queue. By default, recording an event waits for the queue and stores the host time.
+    virtual void* event_create(DeviceId) { return new HostEvent { 0 }; }
+    virtual void event_destroy(DeviceId, void* event) { delete static_cast<HostEvent*>(event); }
+    /// Records the event after the commands enqueued so far on a queue.
+    virtual void event_record(DeviceId dev, void* stream, void* event) {
+        stream_synchronize(dev, stream);
+        static_cast<HostEvent*>(event)->time = host_time();
+    }
+    /// Makes the commands enqueued next on a queue wait for the event, without blocking the host.
+    virtual void event_wait(DeviceId, void*, void*) {}
+    /// Returns whether the commands before the event have completed.
+    virtual bool event_query(DeviceId, void*) { return true; }
+    /// Waits for the commands before the event to complete.
+    virtual void event_synchronize(DeviceId, void*) {}
+    /// Returns the time between two events in nanoseconds, after waiting for them.
+    virtual int64_t event_elapsed(DeviceId, void* start, void* end) {
+        return static_cast<HostEvent*>(end)->time - static_cast<HostEvent*>(start)->time;
+    }
+
+    /// Copies memory between devices of this platform. Copies across platforms are staged through the host by the runtime.
     virtual void copy(DeviceId dev_src, const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) = 0;
+    /// Allocates a pitched 3D buffer. By default, rows are padded to 256 bytes, which suits coalesced accesses on most devices.
+    virtual void* alloc_pitched(DeviceId dev, int64_t width, int64_t height, int64_t depth, int64_t& pitch) {
+        const int64_t row_alignment = 256;
+        pitch = (width + row_alignment - 1) & ~(row_alignment - 1);
+        return alloc(dev, pitch * height * depth);
+    }
+    /// Copies a box between pitched buffers, in the given direction. By default, the box is copied as a batch of rows.
+    virtual void copy_3d(CopyKind kind, DeviceId dev_src, const void* src, Pitch src_pitch, DeviceId dev_dst, void* dst, Pitch dst_pitch, const Region3D& region) {
+        auto rows = row_regions(src, src_pitch, dst, dst_pitch, region);
+        copy_batch(kind, dev_src, dev_dst, rows.data(), rows.size());
+    }
+    /// Copies a batch of regions, in the given direction. By default, the regions are copied one by one.
+    virtual void copy_batch(CopyKind kind, DeviceId dev_src, DeviceId dev_dst, const CopyRegion* regions, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            auto& region = regions[i];
+            switch (kind) {
+                case CopyKind::DeviceToDevice: copy(dev_src, region.src, region.offset_src, dev_dst, region.dst, region.offset_dst, region.size); break;
+                case CopyKind::HostToDevice:   copy_from_host(region.src, region.offset_src, dev_dst, region.dst, region.offset_dst, region.size); break;
+                case CopyKind::DeviceToHost:   copy_to_host(dev_src, region.src, region.offset_src, region.dst, region.offset_dst, region.size); break;
+            }
+        }
+    }
+    /// Fills memory with a pattern of `pattern_size` bytes, which is a power of two dividing `size`.
+    /// By default, the pattern is replicated on the host and copied to the device.
+    virtual void memset(DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) {
+        std::vector<char> buffer(std::min(size, std::max(pattern_size, int64_t(1) << 20)));
+        for (size_t i = 0; i < buffer.size(); i += pattern_size)
+            std::copy_n(static_cast<const char*>(pattern), pattern_size, buffer.data() + i);
+        for (int64_t done = 0; done < size; done += buffer.size())
+            copy_from_host(buffer.data(), 0, dev, ptr, offset + done, std::min(int64_t(buffer.size()), size - done));
+    }
     /// Copies memory from the host (CPU).
     virtual void copy_from_host(const void* src, int64_t offset_src, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) = 0;
     /// Copies memory to the host (CPU).
@@ -60,6 +207,16 @@ public:
     virtual bool device_check_feature_support(DeviceId dev, const char* feature) const = 0;
 
 protected:
+    /// An event recorded on the host, in nanoseconds.
+    struct HostEvent {
+        int64_t time;
+    };
+
+    static int64_t host_time() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
     [[noreturn]] void platform_error() {
         error("The selected '%' platform is not available", name());
     }
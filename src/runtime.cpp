@@ -1,5 +1,11 @@
+#include <algorithm>
 #include <sstream>
 #include <fstream>
+#include <tuple>
+#include <cstring>
+#include <condition_variable>
+#include <functional>
+#include <thread>
 
 #include "anydsl_runtime.h"
 
@@ -7,6 +13,7 @@
 #include "platform.h"
 #include "dummy_platform.h"
 #include "cpu_platform.h"
+#include "convert.h"
 
 #ifndef AnyDSL_runtime_HAS_CUDA_SUPPORT
 void register_cuda_platform(Runtime* runtime) { runtime->register_platform<DummyPlatform>("CUDA"); }
@@ -24,10 +31,42 @@ void register_pal_platform(Runtime* runtime) { runtime->register_platform<DummyP
 void register_levelzero_platform(Runtime* runtime) { runtime->register_platform<DummyPlatform>("Level Zero"); }
 #endif
 
+// Size of the page-locked buffers used to stage transfers from and to pageable host memory
+static constexpr int64_t staging_buffer_size = int64_t(4) << 20;
+// NUMA nodes are numbered below this bound, the largest number of nodes supported by Linux
+static constexpr int32_t max_numa_nodes = 1024;
+
+// Graph captured by the calling thread, if any
+static thread_local CommandGraph* captured_graph = nullptr;
+
+static uint64_t device_key(PlatformId plat, DeviceId dev) {
+    return (uint64_t(plat) << 32) | uint64_t(dev);
+}
+
 Runtime::Runtime(std::pair<ProfileLevel, ProfileLevel> profile)
     : profile_(profile)
     , cache_dir_("")
-{}
+    , memory_limit_(0)
+    , num_evictables_(0)
+{
+    if (const char* env_var = std::getenv("ANYDSL_DEVICE_MEMORY_LIMIT"))
+        memory_limit_ = std::strtoll(env_var, nullptr, 10);
+}
+
+Runtime::~Runtime() {
+    // Staging buffers, constants, and evictable buffers must be released while the platforms are still alive
+    for (auto& [key, constant] : constants_)
+        platforms_[std::get<0>(key)]->release(std::get<1>(key), constant.ptr);
+    for (auto& [handle, evictable] : evictables_) {
+        if (evictable->device)
+            platforms_[evictable->plat]->release(evictable->dev, evictable->device);
+        aligned_free(evictable->host);
+    }
+    for (auto& it : staging_buffers_) {
+        for (auto buffer : it.second)
+            platforms_[it.first >> 32]->release_host(DeviceId(it.first & 0xFFFFFFFF), buffer);
+    }
+}
 
 void Runtime::display_info() const {
     info("Available platforms:");
@@ -50,12 +89,36 @@ bool Runtime::device_check_feature_support(PlatformId plat, DeviceId dev, const
 
 void* Runtime::alloc(PlatformId plat, DeviceId dev, int64_t size) {
     check_device(plat, dev);
-    return platforms_[plat]->alloc(dev, size);
+    if (!evictable_mode() || size == 0)
+        return platforms_[plat]->alloc(dev, size);
+    std::lock_guard<std::mutex> guard(evict_lock_);
+    return alloc_or_evict(plat, dev, size);
+}
+
+void* Runtime::alloc_ex(PlatformId plat, DeviceId dev, int64_t size, const AllocProps& props) {
+    check_device(plat, dev);
+    if (props.alignment < 0 || (props.alignment & (props.alignment - 1)) != 0)
+        error("Invalid allocation alignment %, must be zero or a power of two", props.alignment);
+    if ((props.flags & AllocProps::NumaNode) && (props.numa_node < 0 || props.numa_node >= max_numa_nodes))
+        error("Invalid NUMA node %, must be between 0 and %", props.numa_node, max_numa_nodes - 1);
+    if (!evictable_mode() || size == 0)
+        return platforms_[plat]->alloc_ex(dev, size, props);
+    // Platforms abort when alloc_ex() fails, so only the memory limit can cause evictions here
+    std::lock_guard<std::mutex> guard(evict_lock_);
+    reserve_memory(plat, dev, size);
+    auto ptr = platforms_[plat]->alloc_ex(dev, size, props);
+    track_allocation(plat, dev, ptr, size);
+    return ptr;
 }
 
 void* Runtime::alloc_host(PlatformId plat, DeviceId dev, int64_t size) {
     check_device(plat, dev);
-    return platforms_[plat]->alloc_host(dev, size);
+    auto ptr = platforms_[plat]->alloc_host(dev, size);
+    if (ptr && platforms_[plat]->has_pinned_host_memory(dev)) {
+        std::lock_guard<std::mutex> guard(pinned_lock_);
+        pinned_[reinterpret_cast<uintptr_t>(ptr)] = PinnedRange { size, plat };
+    }
+    return ptr;
 }
 
 void* Runtime::alloc_unified(PlatformId plat, DeviceId dev, int64_t size) {
@@ -70,19 +133,589 @@ void* Runtime::get_device_ptr(PlatformId plat, DeviceId dev, void* ptr) {
 
 void Runtime::release(PlatformId plat, DeviceId dev, void* ptr) {
     check_device(plat, dev);
+    if (evictable_mode()) {
+        std::lock_guard<std::mutex> guard(evict_lock_);
+        if (release_evictable(plat, dev, ptr, false))
+            return;
+        untrack_allocation(plat, dev, ptr);
+    }
     platforms_[plat]->release(dev, ptr);
 }
 
+void Runtime::release_deferred(PlatformId plat, DeviceId dev, void* ptr) {
+    check_device(plat, dev);
+    if (evictable_mode()) {
+        std::lock_guard<std::mutex> guard(evict_lock_);
+        if (release_evictable(plat, dev, ptr, true))
+            return;
+        untrack_allocation(plat, dev, ptr);
+    }
+    platforms_[plat]->release_deferred(dev, ptr);
+}
+
 void Runtime::release_host(PlatformId plat, DeviceId dev, void* ptr) {
     check_device(plat, dev);
+    {
+        std::lock_guard<std::mutex> guard(pinned_lock_);
+        pinned_.erase(reinterpret_cast<uintptr_t>(ptr));
+    }
     platforms_[plat]->release_host(dev, ptr);
 }
 
+bool Runtime::host_register(PlatformId plat, DeviceId dev, void* ptr, int64_t size, int32_t flags) {
+    check_device(plat, dev);
+    if (!platforms_[plat]->host_register(dev, ptr, size, flags)) {
+        debug("Host memory % of % bytes cannot be registered for device % on platform %", ptr, size, dev, plat);
+        return false;
+    }
+    // Registered memory is as fast to transfer as memory from `alloc_host()`
+    if (platforms_[plat]->has_pinned_host_memory(dev)) {
+        std::lock_guard<std::mutex> guard(pinned_lock_);
+        pinned_[reinterpret_cast<uintptr_t>(ptr)] = PinnedRange { size, plat };
+    }
+    return true;
+}
+
+void Runtime::host_unregister(PlatformId plat, DeviceId dev, void* ptr) {
+    check_device(plat, dev);
+    {
+        std::lock_guard<std::mutex> guard(pinned_lock_);
+        pinned_.erase(reinterpret_cast<uintptr_t>(ptr));
+    }
+    platforms_[plat]->host_unregister(dev, ptr);
+}
+
+void* Runtime::upload_constant(PlatformId plat, DeviceId dev, const void* host, int64_t size) {
+    check_device(plat, dev);
+    ConstantKey key(plat, dev, size, hash_bytes(host, size));
+    {
+        std::lock_guard<std::mutex> guard(constants_lock_);
+        auto it = constants_.find(key);
+        if (it != constants_.end()) {
+            it->second.refs++;
+            debug("Reusing constant buffer % of % bytes for device % on platform %", it->second.ptr, size, dev, plat);
+            return it->second.ptr;
+        }
+    }
+
+    // The upload happens without the lock, and loses against a concurrent upload of the same data
+    AllocProps props = {};
+    props.usage = AllocProps::ReadOnly;
+    void* ptr = alloc_ex(plat, dev, size, props);
+    copy(PlatformId(0), DeviceId(0), host, 0, plat, dev, ptr, 0, size);
+
+    std::lock_guard<std::mutex> guard(constants_lock_);
+    auto [it, inserted] = constants_.emplace(key, Constant { ptr, 0 });
+    if (!inserted)
+        release(plat, dev, ptr);
+    else
+        constant_keys_.emplace(std::make_tuple(plat, dev, ptr), key);
+    it->second.refs++;
+    return it->second.ptr;
+}
+
+void Runtime::release_constant(PlatformId plat, DeviceId dev, void* ptr) {
+    check_device(plat, dev);
+    std::lock_guard<std::mutex> guard(constants_lock_);
+    auto key_it = constant_keys_.find(std::make_tuple(plat, dev, ptr));
+    if (key_it == constant_keys_.end())
+        error("Pointer % was not returned by upload_constant() for device % on platform %", ptr, dev, plat);
+    auto it = constants_.find(key_it->second);
+    if (--it->second.refs == 0) {
+        release(plat, dev, ptr);
+        constants_.erase(it);
+        constant_keys_.erase(key_it);
+    }
+}
+
+bool Runtime::is_pinned(PlatformId plat, const void* ptr, int64_t size) {
+    auto addr = reinterpret_cast<uintptr_t>(ptr);
+    std::lock_guard<std::mutex> guard(pinned_lock_);
+    auto it = pinned_.upper_bound(addr);
+    if (it == pinned_.begin())
+        return false;
+    --it;
+    return it->second.plat == plat && addr + size <= it->first + it->second.size;
+}
+
+void* Runtime::acquire_staging_buffer(PlatformId plat, DeviceId dev) {
+    {
+        std::lock_guard<std::mutex> guard(staging_lock_);
+        auto& buffers = staging_buffers_[device_key(plat, dev)];
+        if (!buffers.empty()) {
+            auto buffer = buffers.back();
+            buffers.pop_back();
+            return buffer;
+        }
+    }
+    debug("Allocating staging buffer for device % on platform %", dev, plat);
+    return platforms_[plat]->alloc_host(dev, staging_buffer_size);
+}
+
+void Runtime::release_staging_buffer(PlatformId plat, DeviceId dev, void* buffer) {
+    std::lock_guard<std::mutex> guard(staging_lock_);
+    staging_buffers_[device_key(plat, dev)].push_back(buffer);
+}
+
+/// A thread that produces the chunks of `pipeline()`. Idle workers are kept for later pipelines,
+/// so that staged copies do not create threads.
+class StagingWorker {
+public:
+    StagingWorker() : thread_([this] { work(); }) {
+        thread_.detach();
+    }
+
+    /// Starts running the task on the worker.
+    void start(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            task_ = std::move(task);
+        }
+        cond_.notify_all();
+    }
+
+    /// Waits for the task started last to complete.
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock_);
+        cond_.wait(guard, [&] { return !task_ && !running_; });
+    }
+
+    static StagingWorker* acquire() {
+        std::lock_guard<std::mutex> guard(idle_lock_);
+        if (idle_.empty())
+            return new StagingWorker();
+        auto worker = idle_.back();
+        idle_.pop_back();
+        return worker;
+    }
+
+    /// Keeps the worker for later pipelines. Idle workers are never destroyed, as joining threads while
+    /// static objects are destroyed at exit may deadlock.
+    static void release(StagingWorker* worker) {
+        std::lock_guard<std::mutex> guard(idle_lock_);
+        idle_.push_back(worker);
+    }
+
+private:
+    void work() {
+        std::unique_lock<std::mutex> guard(lock_);
+        while (true) {
+            cond_.wait(guard, [&] { return bool(task_); });
+            auto task = std::move(task_);
+            task_ = nullptr;
+            running_ = true;
+            guard.unlock();
+            task();
+            guard.lock();
+            running_ = false;
+            cond_.notify_all();
+        }
+    }
+
+    std::mutex lock_;
+    std::condition_variable cond_;
+    std::function<void()> task_;
+    bool running_ = false;
+    std::thread thread_;
+
+    static std::mutex idle_lock_;
+    static std::vector<StagingWorker*> idle_;
+};
+
+std::mutex StagingWorker::idle_lock_;
+std::vector<StagingWorker*> StagingWorker::idle_;
+
+/// Runs `produce(i + 1)` on a staging worker while `consume(i)` runs, for every chunk `i`.
+template <typename P, typename C>
+static void pipeline(int64_t num_chunks, const P& produce, const C& consume) {
+    if (num_chunks == 0)
+        return;
+    produce(0);
+    if (num_chunks == 1)
+        return consume(0);
+
+    auto worker = StagingWorker::acquire();
+    for (int64_t i = 0; i < num_chunks; ++i) {
+        if (i + 1 < num_chunks)
+            worker->start([&, i] { produce(i + 1); });
+        consume(i);
+        worker->wait();
+    }
+    StagingWorker::release(worker);
+}
+
+void Runtime::copy_staged_from_host(const char* src, PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
+    auto& host = platforms_[0];
+    auto& device = platforms_[plat_dst];
+    void* staging[2] = { acquire_staging_buffer(plat_dst, dev_dst), acquire_staging_buffer(plat_dst, dev_dst) };
+
+    auto chunk_size = [=] (int64_t i) { return std::min(staging_buffer_size, size - i * staging_buffer_size); };
+    pipeline((size + staging_buffer_size - 1) / staging_buffer_size,
+        [&] (int64_t i) { host->copy(DeviceId(0), src, i * staging_buffer_size, DeviceId(0), staging[i % 2], 0, chunk_size(i)); },
+        [&] (int64_t i) { device->copy_from_host(staging[i % 2], 0, dev_dst, dst, offset_dst + i * staging_buffer_size, chunk_size(i)); });
+
+    release_staging_buffer(plat_dst, dev_dst, staging[0]);
+    release_staging_buffer(plat_dst, dev_dst, staging[1]);
+}
+
+void Runtime::copy_staged_to_host(PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src, char* dst, int64_t size) {
+    auto& host = platforms_[0];
+    auto& device = platforms_[plat_src];
+    void* staging[2] = { acquire_staging_buffer(plat_src, dev_src), acquire_staging_buffer(plat_src, dev_src) };
+
+    auto chunk_size = [=] (int64_t i) { return std::min(staging_buffer_size, size - i * staging_buffer_size); };
+    pipeline((size + staging_buffer_size - 1) / staging_buffer_size,
+        [&] (int64_t i) { device->copy_to_host(dev_src, src, offset_src + i * staging_buffer_size, staging[i % 2], 0, chunk_size(i)); },
+        [&] (int64_t i) { host->copy(DeviceId(0), staging[i % 2], 0, DeviceId(0), dst, i * staging_buffer_size, chunk_size(i)); });
+
+    release_staging_buffer(plat_src, dev_src, staging[0]);
+    release_staging_buffer(plat_src, dev_src, staging[1]);
+}
+
+void Runtime::mem_advise(PlatformId plat, DeviceId dev, void* ptr, int64_t size, MemAdvice advice) {
+    check_device(plat, dev);
+    EvictablePins pins(*this);
+    ptr = pins.resolve(plat, dev, ptr);
+    platforms_[plat]->mem_advise(dev, ptr, size, advice);
+}
+
+void Runtime::mem_prefetch(PlatformId plat, DeviceId dev, void* ptr, int64_t size) {
+    check_device(plat, dev);
+    EvictablePins pins(*this);
+    ptr = pins.resolve(plat, dev, ptr);
+    platforms_[plat]->mem_prefetch(dev, ptr, size);
+}
+
+void Runtime::memset(PlatformId plat, DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size) {
+    check_device(plat, dev);
+    if (pattern_size <= 0 || pattern_size > 128 || (pattern_size & (pattern_size - 1)) != 0)
+        error("Invalid memset pattern size %, must be a power of two not larger than 128", pattern_size);
+    if (size % pattern_size != 0)
+        error("Memset size % is not a multiple of the pattern size %", size, pattern_size);
+    if (size > 0) {
+        EvictablePins pins(*this);
+        ptr = pins.resolve(plat, dev, ptr);
+        platforms_[plat]->memset(dev, ptr, offset, pattern, pattern_size, size);
+    }
+}
+
+void* Runtime::alloc_shared(const char* name, int64_t size, int32_t flags) {
+    return platforms_[0]->alloc_shared(DeviceId(0), name, size, flags);
+}
+
+void* Runtime::open_shared(const char* name, int64_t& size) {
+    return platforms_[0]->open_shared(DeviceId(0), name, size);
+}
+
+void* Runtime::alloc_reserve(PlatformId plat, DeviceId dev, int64_t max_size) {
+    check_device(plat, dev);
+    return platforms_[plat]->alloc_reserve(dev, max_size);
+}
+
+void Runtime::commit(PlatformId plat, DeviceId dev, void* ptr, int64_t size) {
+    check_device(plat, dev);
+    platforms_[plat]->commit(dev, ptr, size);
+}
+
+void Runtime::decommit(PlatformId plat, DeviceId dev, void* ptr, int64_t size) {
+    check_device(plat, dev);
+    platforms_[plat]->decommit(dev, ptr, size);
+}
+
+void* Runtime::realloc(PlatformId plat, DeviceId dev, void* ptr, int64_t old_size, int64_t new_size) {
+    check_device(plat, dev);
+    if (memory_limit_ > 0) {
+        std::lock_guard<std::mutex> guard(evict_lock_);
+        untrack_allocation(plat, dev, ptr);
+    }
+    auto new_ptr = platforms_[plat]->realloc(dev, ptr, old_size, new_size);
+    if (memory_limit_ > 0) {
+        std::lock_guard<std::mutex> guard(evict_lock_);
+        track_allocation(plat, dev, new_ptr, new_size);
+    }
+    return new_ptr;
+}
+
+void* Runtime::snapshot(PlatformId plat, DeviceId dev, const void* ptr, int64_t size) {
+    check_device(plat, dev);
+    return platforms_[plat]->snapshot(dev, ptr, size);
+}
+
+void* Runtime::alloc_evictable(PlatformId plat, DeviceId dev, int64_t size) {
+    check_device(plat, dev);
+    if (size <= 0)
+        error("Invalid evictable buffer size %, must be positive", size);
+    auto evictable = std::make_unique<Evictable>();
+    evictable->plat = plat;
+    evictable->dev = dev;
+    evictable->size = size;
+    evictable->host = nullptr;
+    evictable->pins = 0;
+
+    std::lock_guard<std::mutex> guard(evict_lock_);
+    evictable->device = alloc_or_evict(plat, dev, size);
+    lru_.push_front(evictable.get());
+    evictable->lru = lru_.begin();
+    void* handle = evictable.get();
+    evictables_.emplace(handle, std::move(evictable));
+    num_evictables_++;
+    return handle;
+}
+
+bool Runtime::release_evictable(PlatformId plat, DeviceId dev, void* ptr, bool deferred) {
+    auto it = evictables_.find(ptr);
+    if (it == evictables_.end())
+        return false;
+    auto evictable = it->second.get();
+    assert(evictable->plat == plat && evictable->dev == dev && "Evictable buffer released on another device");
+    if (evictable->device) {
+        untrack_allocation(plat, dev, evictable->device);
+        if (deferred)
+            platforms_[plat]->release_deferred(dev, evictable->device);
+        else
+            platforms_[plat]->release(dev, evictable->device);
+        lru_.erase(evictable->lru);
+    }
+    aligned_free(evictable->host);
+    evictables_.erase(it);
+    num_evictables_--;
+    return true;
+}
+
+void* Runtime::alloc_or_evict(PlatformId plat, DeviceId dev, int64_t size) {
+    while (true) {
+        reserve_memory(plat, dev, size);
+        if (auto ptr = platforms_[plat]->try_alloc(dev, size)) {
+            track_allocation(plat, dev, ptr, size);
+            return ptr;
+        }
+        if (!evict_one(plat, dev))
+            error("Out of memory allocating % bytes on device % of platform %, with no buffer left to evict", size, dev, plat);
+    }
+}
+
+void Runtime::reserve_memory(PlatformId plat, DeviceId dev, int64_t size) {
+    if (memory_limit_ == 0)
+        return;
+    if (size > memory_limit_)
+        error("Allocation of % bytes exceeds the device memory limit of % bytes", size, memory_limit_);
+    auto& used = memory_used_[device_key(plat, dev)];
+    while (used + size > memory_limit_) {
+        if (!evict_one(plat, dev))
+            error("Out of memory allocating % bytes on device % of platform %, with % bytes used and no buffer left to evict", size, dev, plat, used);
+    }
+}
+
+bool Runtime::evict_one(PlatformId plat, DeviceId dev) {
+    auto it = std::find_if(lru_.rbegin(), lru_.rend(), [&] (const Evictable* evictable) {
+        return evictable->plat == plat && evictable->dev == dev && evictable->pins == 0;
+    });
+    if (it == lru_.rend())
+        return false;
+
+    // Kernels that were launched with the buffer may still be running, the host platform has none
+    auto victim = *it;
+    if (plat != 0)
+        platforms_[plat]->synchronize(dev);
+    victim->host = aligned_malloc(victim->size, 64);
+    if (!victim->host)
+        error("Cannot allocate % bytes of host memory to evict a buffer from device % of platform %", victim->size, dev, plat);
+    platforms_[plat]->copy_to_host(dev, victim->device, 0, victim->host, 0, victim->size);
+    untrack_allocation(plat, dev, victim->device);
+    platforms_[plat]->release(dev, victim->device);
+    victim->device = nullptr;
+    lru_.erase(victim->lru);
+    debug("Evicted % bytes from device % of platform % to the host", victim->size, dev, plat);
+    return true;
+}
+
+void Runtime::restore(Evictable* evictable) {
+    auto plat = evictable->plat;
+    auto dev = evictable->dev;
+    auto device = alloc_or_evict(plat, dev, evictable->size);
+    platforms_[plat]->copy_from_host(evictable->host, 0, dev, device, 0, evictable->size);
+    aligned_free(evictable->host);
+    evictable->host = nullptr;
+    evictable->device = device;
+    lru_.push_front(evictable);
+    evictable->lru = lru_.begin();
+    debug("Restored % bytes to device % of platform %", evictable->size, dev, plat);
+}
+
+void Runtime::track_allocation(PlatformId plat, DeviceId dev, void* ptr, int64_t size) {
+    if (memory_limit_ == 0 || !ptr)
+        return;
+    memory_used_[device_key(plat, dev)] += size;
+    allocation_sizes_[std::make_tuple(plat, dev, ptr)] = size;
+}
+
+void Runtime::untrack_allocation(PlatformId plat, DeviceId dev, void* ptr) {
+    if (memory_limit_ == 0)
+        return;
+    auto it = allocation_sizes_.find(std::make_tuple(plat, dev, ptr));
+    if (it == allocation_sizes_.end())
+        return;
+    memory_used_[device_key(plat, dev)] -= it->second;
+    allocation_sizes_.erase(it);
+}
+
+void* Runtime::EvictablePins::resolve(PlatformId plat, DeviceId dev, const void* ptr) {
+    if (runtime.num_evictables_.load(std::memory_order_relaxed) == 0)
+        return const_cast<void*>(ptr);
+
+    std::lock_guard<std::mutex> guard(runtime.evict_lock_);
+    auto it = runtime.evictables_.find(ptr);
+    if (it == runtime.evictables_.end())
+        return const_cast<void*>(ptr);
+    auto evictable = it->second.get();
+    if (evictable->plat != plat || evictable->dev != dev)
+        error("Evictable buffer of device % on platform % used on device % of platform %", evictable->dev, evictable->plat, dev, plat);
+    if (evictable->device)
+        runtime.lru_.splice(runtime.lru_.begin(), runtime.lru_, evictable->lru);
+    else
+        runtime.restore(evictable);
+    evictable->pins++;
+    buffers.push_back(evictable);
+    return evictable->device;
+}
+
+Runtime::EvictablePins::~EvictablePins() {
+    if (buffers.empty())
+        return;
+    std::lock_guard<std::mutex> guard(runtime.evict_lock_);
+    for (auto evictable : buffers)
+        evictable->pins--;
+}
+
+Arena* Runtime::arena_create(PlatformId plat, DeviceId dev, int64_t capacity) {
+    check_device(plat, dev);
+    if (!platforms_[plat]->has_addressable_memory(dev))
+        error("Arenas require addressable device memory, which device % of platform % does not have", dev, plat);
+    auto data = alloc(plat, dev, capacity);
+    return new Arena { plat, dev, static_cast<char*>(data), capacity, 0 };
+}
+
+void* Runtime::arena_alloc(Arena* arena, int64_t size, int64_t align) {
+    if (align <= 0 || (align & (align - 1)) != 0)
+        error("Invalid arena alignment %, must be a power of two", align);
+    auto addr = reinterpret_cast<uintptr_t>(arena->data) + arena->offset;
+    auto begin = arena->offset + static_cast<int64_t>(((addr + align - 1) & ~uintptr_t(align - 1)) - addr);
+    if (begin + size > arena->capacity)
+        return nullptr;
+    arena->offset = begin + size;
+    debug("Arena allocation of % bytes at offset % on device % of platform %", size, begin, arena->dev, arena->plat);
+    return arena->data + begin;
+}
+
+void Runtime::arena_reset(Arena* arena) {
+    arena->offset = 0;
+}
+
+void Runtime::arena_destroy(Arena* arena) {
+    if (arena->data)
+        release(arena->plat, arena->dev, arena->data);
+    delete arena;
+}
+
+Mirror* Runtime::mirror_create(PlatformId plat, DeviceId dev, int64_t size) {
+    check_device(plat, dev);
+    auto mirror = new Mirror;
+    mirror->plat = plat;
+    mirror->dev = dev;
+    mirror->size = size;
+    if (plat == 0) {
+        mirror->data[Mirror::Host] = mirror->data[Mirror::Device] = alloc(plat, dev, size);
+    } else {
+        mirror->data[Mirror::Host] = alloc_host(plat, dev, size);
+        mirror->data[Mirror::Device] = alloc(plat, dev, size);
+    }
+    mirror->versions[Mirror::Host] = mirror->versions[Mirror::Device] = 0;
+    return mirror;
+}
+
+/// Adds a range to a sorted list of disjoint ranges, merging it with the ranges it overlaps or touches.
+static void add_dirty_range(std::vector<std::pair<int64_t, int64_t>>& ranges, int64_t begin, int64_t end) {
+    // Past this number of ranges, tracking them costs more than copying the gaps between them
+    const size_t max_ranges = 64;
+    auto first = std::lower_bound(ranges.begin(), ranges.end(), begin, [] (auto& range, int64_t value) { return range.second < value; });
+    auto last = first;
+    while (last != ranges.end() && last->first <= end) {
+        begin = std::min(begin, last->first);
+        end = std::max(end, last->second);
+        ++last;
+    }
+    first = ranges.erase(first, last);
+    ranges.emplace(first, begin, end);
+    if (ranges.size() > max_ranges)
+        ranges = { { ranges.front().first, ranges.back().second } };
+}
+
+void* Runtime::mirror_acquire(Mirror* mirror, Mirror::Side side, int32_t access, int64_t offset, int64_t size) {
+    if (offset < 0 || size < 0 || offset + size > mirror->size)
+        error("Range [%, %) is outside of the mirrored buffer of % bytes", offset, offset + size, mirror->size);
+
+    std::lock_guard<std::mutex> guard(mirror->lock);
+    if (mirror->plat == 0)
+        return mirror->data[side];
+
+    auto other = side == Mirror::Host ? Mirror::Device : Mirror::Host;
+    if (mirror->versions[other] > mirror->versions[side]) {
+        // Nothing needs to be copied when the whole buffer is about to be overwritten
+        bool overwritten = !(access & Mirror::Read) && offset == 0 && size == mirror->size;
+        if (!overwritten) {
+            std::vector<CopyRegion> regions;
+            for (auto& range : mirror->dirty)
+                regions.push_back(CopyRegion { mirror->data[other], range.first, mirror->data[side], range.first, range.second - range.first });
+            if (side == Mirror::Host) {
+                // Kernels that write the device side must have completed
+                synchronize(mirror->plat, mirror->dev);
+                copy_batch(mirror->plat, mirror->dev, PlatformId(0), DeviceId(0), regions);
+            } else {
+                copy_batch(PlatformId(0), DeviceId(0), mirror->plat, mirror->dev, regions);
+            }
+            debug("Synchronized % range(s) of mirrored buffer % on the %", mirror->dirty.size(), mirror, side == Mirror::Host ? "host" : "device");
+        }
+        mirror->dirty.clear();
+        mirror->versions[side] = mirror->versions[other];
+    }
+
+    if ((access & Mirror::Write) && size > 0) {
+        mirror->versions[side] = std::max(mirror->versions[side], mirror->versions[other]) + 1;
+        add_dirty_range(mirror->dirty, offset, offset + size);
+    }
+    return mirror->data[side];
+}
+
+void Runtime::mirror_destroy(Mirror* mirror) {
+    if (mirror->plat == 0) {
+        release(mirror->plat, mirror->dev, mirror->data[Mirror::Host]);
+    } else {
+        release_host(mirror->plat, mirror->dev, mirror->data[Mirror::Host]);
+        release(mirror->plat, mirror->dev, mirror->data[Mirror::Device]);
+    }
+    delete mirror;
+}
+
 void Runtime::copy(
     PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
     PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
     check_device(plat_src, dev_src);
     check_device(plat_dst, dev_dst);
+    if (auto graph = captured_graph) {
+        if ((graph->plat == plat_src && graph->dev == dev_src) || (graph->plat == plat_dst && graph->dev == dev_dst)) {
+            CopyRegion region { src, offset_src, dst, offset_dst, size };
+            graph->commands.emplace_back(CommandGraph::Copy { plat_src, dev_src, plat_dst, dev_dst, { region } });
+        }
+    }
+    transfer(plat_src, dev_src, src, offset_src, plat_dst, dev_dst, dst, offset_dst, size);
+}
+
+void Runtime::transfer(
+    PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+    PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
+    EvictablePins pins(*this);
+    src = pins.resolve(plat_src, dev_src, src);
+    dst = pins.resolve(plat_dst, dev_dst, dst);
     if (plat_src == plat_dst) {
         // Copy from same platform
         platforms_[plat_src]->copy(dev_src, src, offset_src, dev_dst, dst, offset_dst, size);
@@ -91,25 +724,379 @@ void Runtime::copy(
         // Copy from another platform
         if (plat_src == 0) {
             // Source is the CPU platform
-            platforms_[plat_dst]->copy_from_host(src, offset_src, dev_dst, dst, offset_dst, size);
-            debug("Copy from host to device % on platform %", dev_dst, plat_dst);
+            auto src_ptr = static_cast<const char*>(src) + offset_src;
+            if (size > staging_buffer_size && platforms_[plat_dst]->has_pinned_host_memory(dev_dst) && !is_pinned(plat_dst, src_ptr, size)) {
+                copy_staged_from_host(src_ptr, plat_dst, dev_dst, dst, offset_dst, size);
+                debug("Staged copy from host to device % on platform %", dev_dst, plat_dst);
+            } else {
+                platforms_[plat_dst]->copy_from_host(src, offset_src, dev_dst, dst, offset_dst, size);
+                debug("Copy from host to device % on platform %", dev_dst, plat_dst);
+            }
         } else if (plat_dst == 0) {
             // Destination is the CPU platform
-            platforms_[plat_src]->copy_to_host(dev_src, src, offset_src, dst, offset_dst, size);
-            debug("Copy to host from device % on platform %", dev_src, plat_src);
+            auto dst_ptr = static_cast<char*>(dst) + offset_dst;
+            if (size > staging_buffer_size && platforms_[plat_src]->has_pinned_host_memory(dev_src) && !is_pinned(plat_src, dst_ptr, size)) {
+                copy_staged_to_host(plat_src, dev_src, src, offset_src, dst_ptr, size);
+                debug("Staged copy to host from device % on platform %", dev_src, plat_src);
+            } else {
+                platforms_[plat_src]->copy_to_host(dev_src, src, offset_src, dst, offset_dst, size);
+                debug("Copy to host from device % on platform %", dev_src, plat_src);
+            }
         } else {
-            error("Cannot copy memory between different platforms");
+            copy_staged(plat_src, dev_src, src, offset_src, plat_dst, dev_dst, dst, offset_dst, size);
+            debug("Staged copy from device % on platform % to device % on platform %", dev_src, plat_src, dev_dst, plat_dst);
+        }
+    }
+}
+
+void* Runtime::alloc_pitched(PlatformId plat, DeviceId dev, int64_t width, int64_t height, int64_t depth, int64_t& pitch) {
+    check_device(plat, dev);
+    if (!evictable_mode())
+        return platforms_[plat]->alloc_pitched(dev, width, height, depth, pitch);
+    // The pitch is only known once the buffer is allocated, so the limit is enforced for the unpadded size
+    std::lock_guard<std::mutex> guard(evict_lock_);
+    reserve_memory(plat, dev, width * height * depth);
+    auto ptr = platforms_[plat]->alloc_pitched(dev, width, height, depth, pitch);
+    track_allocation(plat, dev, ptr, pitch * height * depth);
+    return ptr;
+}
+
+void Runtime::copy_3d(
+    PlatformId plat_src, DeviceId dev_src, const void* src, Pitch src_pitch,
+    PlatformId plat_dst, DeviceId dev_dst, void* dst, Pitch dst_pitch,
+    const Region3D& region) {
+    check_device(plat_src, dev_src);
+    check_device(plat_dst, dev_dst);
+    if (region.width <= 0 || region.height <= 0 || region.depth <= 0)
+        return;
+    if (src_pitch.row <= 0 || src_pitch.slice < src_pitch.row * region.height ||
+        dst_pitch.row <= 0 || dst_pitch.slice < dst_pitch.row * region.height)
+        error("Invalid pitch for a 3D copy");
+    if (region.src_x < 0 || region.src_y < 0 || region.src_z < 0 ||
+        region.dst_x < 0 || region.dst_y < 0 || region.dst_z < 0)
+        error("3D copy region has negative coordinates");
+    if (region.src_x + region.width > src_pitch.row || region.src_y + region.height > src_pitch.slice / src_pitch.row ||
+        region.dst_x + region.width > dst_pitch.row || region.dst_y + region.height > dst_pitch.slice / dst_pitch.row)
+        error("3D copy region does not fit in the pitch of the source or destination");
+
+    EvictablePins pins(*this);
+    src = pins.resolve(plat_src, dev_src, src);
+    dst = pins.resolve(plat_dst, dev_dst, dst);
+
+    if (plat_src == plat_dst) {
+        platforms_[plat_src]->copy_3d(CopyKind::DeviceToDevice, dev_src, src, src_pitch, dev_dst, dst, dst_pitch, region);
+        debug("3D copy between devices % and % on platform %", dev_src, dev_dst, plat_src);
+    } else if (plat_src == 0) {
+        platforms_[plat_dst]->copy_3d(CopyKind::HostToDevice, dev_src, src, src_pitch, dev_dst, dst, dst_pitch, region);
+        debug("3D copy from host to device % on platform %", dev_dst, plat_dst);
+    } else if (plat_dst == 0) {
+        platforms_[plat_src]->copy_3d(CopyKind::DeviceToHost, dev_src, src, src_pitch, dev_dst, dst, dst_pitch, region);
+        debug("3D copy to host from device % on platform %", dev_src, plat_src);
+    } else {
+        auto rows = row_regions(src, src_pitch, dst, dst_pitch, region);
+        copy_batch(plat_src, dev_src, plat_dst, dev_dst, rows);
+    }
+}
+
+void Runtime::copy_convert(
+    PlatformId plat_src, DeviceId dev_src, const void* src, ElemType src_type,
+    PlatformId plat_dst, DeviceId dev_dst, void* dst, ElemType dst_type,
+    int64_t count, float scale, float bias) {
+    check_device(plat_src, dev_src);
+    check_device(plat_dst, dev_dst);
+    if (count <= 0)
+        return;
+
+    EvictablePins pins(*this);
+    src = pins.resolve(plat_src, dev_src, src);
+    dst = pins.resolve(plat_dst, dev_dst, dst);
+    int64_t src_size = elem_size(src_type);
+    int64_t dst_size = elem_size(dst_type);
+    if (plat_src == 0 && plat_dst == 0) {
+        parallel_convert(src_type, src, dst_type, dst, count, scale, bias);
+        debug("Converting copy of % elements on the host", count);
+        return;
+    }
+
+    // Chunks of elements are converted on the host while the previous chunk is being transferred
+    auto& source = platforms_[plat_src];
+    auto& target = platforms_[plat_dst];
+    int64_t chunk = staging_buffer_size / std::max(src_size, dst_size);
+    auto chunk_size = [=] (int64_t i) { return std::min(chunk, count - i * chunk); };
+    auto num_chunks = (count + chunk - 1) / chunk;
+    auto src_ptr = static_cast<const char*>(src);
+    auto dst_ptr = static_cast<char*>(dst);
+
+    if (plat_src == 0) {
+        void* staging[2] = { acquire_staging_buffer(plat_dst, dev_dst), acquire_staging_buffer(plat_dst, dev_dst) };
+        pipeline(num_chunks,
+            [&] (int64_t i) { parallel_convert(src_type, src_ptr + i * chunk * src_size, dst_type, staging[i % 2], chunk_size(i), scale, bias); },
+            [&] (int64_t i) { target->copy_from_host(staging[i % 2], 0, dev_dst, dst, i * chunk * dst_size, chunk_size(i) * dst_size); });
+        release_staging_buffer(plat_dst, dev_dst, staging[0]);
+        release_staging_buffer(plat_dst, dev_dst, staging[1]);
+        debug("Converting copy of % elements from host to device % on platform %", count, dev_dst, plat_dst);
+    } else if (plat_dst == 0) {
+        void* staging[2] = { acquire_staging_buffer(plat_src, dev_src), acquire_staging_buffer(plat_src, dev_src) };
+        pipeline(num_chunks,
+            [&] (int64_t i) { source->copy_to_host(dev_src, src, i * chunk * src_size, staging[i % 2], 0, chunk_size(i) * src_size); },
+            [&] (int64_t i) { parallel_convert(src_type, staging[i % 2], dst_type, dst_ptr + i * chunk * dst_size, chunk_size(i), scale, bias); });
+        release_staging_buffer(plat_src, dev_src, staging[0]);
+        release_staging_buffer(plat_src, dev_src, staging[1]);
+        debug("Converting copy of % elements to host from device % on platform %", count, dev_src, plat_src);
+    } else {
+        // The download and the conversion form the first stage, the upload the second one
+        void* staging_src[2] = { acquire_staging_buffer(plat_src, dev_src), acquire_staging_buffer(plat_src, dev_src) };
+        void* staging_dst[2] = { acquire_staging_buffer(plat_dst, dev_dst), acquire_staging_buffer(plat_dst, dev_dst) };
+        pipeline(num_chunks,
+            [&] (int64_t i) {
+                source->copy_to_host(dev_src, src, i * chunk * src_size, staging_src[i % 2], 0, chunk_size(i) * src_size);
+                parallel_convert(src_type, staging_src[i % 2], dst_type, staging_dst[i % 2], chunk_size(i), scale, bias);
+            },
+            [&] (int64_t i) { target->copy_from_host(staging_dst[i % 2], 0, dev_dst, dst, i * chunk * dst_size, chunk_size(i) * dst_size); });
+        for (int i = 0; i < 2; ++i) {
+            release_staging_buffer(plat_src, dev_src, staging_src[i]);
+            release_staging_buffer(plat_dst, dev_dst, staging_dst[i]);
         }
+        debug("Converting copy of % elements from device % on platform % to device % on platform %", count, dev_src, plat_src, dev_dst, plat_dst);
+    }
+}
+
+/// Sorts the regions and merges those that are contiguous in both the source and the destination.
+static void coalesce_regions(std::vector<CopyRegion>& regions) {
+    std::sort(regions.begin(), regions.end(), [] (const CopyRegion& a, const CopyRegion& b) {
+        return std::tie(a.src, a.dst, a.offset_src) < std::tie(b.src, b.dst, b.offset_src);
+    });
+    size_t last = 0;
+    for (size_t i = 1; i < regions.size(); ++i) {
+        auto& prev = regions[last];
+        auto& cur  = regions[i];
+        if (cur.src == prev.src && cur.dst == prev.dst &&
+            cur.offset_src == prev.offset_src + prev.size &&
+            cur.offset_dst == prev.offset_dst + prev.size)
+            prev.size += cur.size;
+        else
+            regions[++last] = cur;
+    }
+    regions.resize(regions.empty() ? 0 : last + 1);
+}
+
+void Runtime::copy_batch(
+    PlatformId plat_src, DeviceId dev_src,
+    PlatformId plat_dst, DeviceId dev_dst,
+    std::vector<CopyRegion>& regions) {
+    check_device(plat_src, dev_src);
+    check_device(plat_dst, dev_dst);
+    // The batch is captured as one command, as its regions are reordered and copied on different paths
+    if (auto graph = captured_graph) {
+        if ((graph->plat == plat_src && graph->dev == dev_src) || (graph->plat == plat_dst && graph->dev == dev_dst))
+            graph->commands.emplace_back(CommandGraph::Copy { plat_src, dev_src, plat_dst, dev_dst, regions });
+    }
+    coalesce_regions(regions);
+
+    // Regions copied with `transfer()` resolve their evictable handles there, the others are resolved here
+    EvictablePins pins(*this);
+    auto resolve = [&] (CopyRegion& region) {
+        region.src = pins.resolve(plat_src, dev_src, region.src);
+        region.dst = pins.resolve(plat_dst, dev_dst, region.dst);
+    };
+    if (plat_src == plat_dst) {
+        std::for_each(regions.begin(), regions.end(), resolve);
+        platforms_[plat_src]->copy_batch(CopyKind::DeviceToDevice, dev_src, dev_dst, regions.data(), regions.size());
+        debug("Batch of % copies between devices % and % on platform %", regions.size(), dev_src, dev_dst, plat_src);
+        return;
+    }
+    if (plat_src != 0 && plat_dst != 0) {
+        for (auto& region : regions)
+            transfer(plat_src, dev_src, region.src, region.offset_src, plat_dst, dev_dst, region.dst, region.offset_dst, region.size);
+        return;
+    }
+
+    // Regions that are large enough to be staged through page-locked memory take the regular path
+    auto large = std::stable_partition(regions.begin(), regions.end(), [] (const CopyRegion& region) {
+        return region.size <= staging_buffer_size;
+    });
+    for (auto it = large; it != regions.end(); ++it)
+        transfer(plat_src, dev_src, it->src, it->offset_src, plat_dst, dev_dst, it->dst, it->offset_dst, it->size);
+    size_t count = large - regions.begin();
+    std::for_each(regions.begin(), large, resolve);
+    if (plat_src == 0) {
+        platforms_[plat_dst]->copy_batch(CopyKind::HostToDevice, dev_src, dev_dst, regions.data(), count);
+        debug("Batch of % copies from host to device % on platform %", count, dev_dst, plat_dst);
+    } else {
+        platforms_[plat_src]->copy_batch(CopyKind::DeviceToHost, dev_src, dev_dst, regions.data(), count);
+        debug("Batch of % copies to host from device % on platform %", count, dev_src, plat_src);
     }
 }
 
+void Runtime::copy_staged(
+    PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+    PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
+    // Page-locked memory from either side speeds up at least one half of the transfer
+    auto plat_staging = PlatformId(0);
+    auto dev_staging  = DeviceId(0);
+    if (platforms_[plat_src]->has_pinned_host_memory(dev_src)) {
+        plat_staging = plat_src;
+        dev_staging  = dev_src;
+    } else if (platforms_[plat_dst]->has_pinned_host_memory(dev_dst)) {
+        plat_staging = plat_dst;
+        dev_staging  = dev_dst;
+    }
+
+    auto& source = platforms_[plat_src];
+    auto& target = platforms_[plat_dst];
+    void* staging[2] = { acquire_staging_buffer(plat_staging, dev_staging), acquire_staging_buffer(plat_staging, dev_staging) };
+
+    auto chunk_size = [=] (int64_t i) { return std::min(staging_buffer_size, size - i * staging_buffer_size); };
+    pipeline((size + staging_buffer_size - 1) / staging_buffer_size,
+        [&] (int64_t i) { source->copy_to_host(dev_src, src, offset_src + i * staging_buffer_size, staging[i % 2], 0, chunk_size(i)); },
+        [&] (int64_t i) { target->copy_from_host(staging[i % 2], 0, dev_dst, dst, offset_dst + i * staging_buffer_size, chunk_size(i)); });
+
+    release_staging_buffer(plat_staging, dev_staging, staging[0]);
+    release_staging_buffer(plat_staging, dev_staging, staging[1]);
+}
+
 void Runtime::launch_kernel(PlatformId plat, DeviceId dev, const LaunchParams& launch_params) {
     check_device(plat, dev);
+    launch(plat, dev, nullptr, nullptr, launch_params);
+    if (captured_graph && captured_graph->plat == plat && captured_graph->dev == dev)
+        capture_launch(captured_graph, get_kernel(plat, dev, launch_params.file_name, launch_params.kernel_name), launch_params);
+}
+
+KernelHandle* Runtime::get_kernel(PlatformId plat, DeviceId dev, const char* file_name, const char* kernel_name) {
+    check_device(plat, dev);
+    auto key = std::make_tuple(plat, dev, std::string(file_name), std::string(kernel_name));
+    {
+        std::lock_guard<std::mutex> guard(kernels_lock_);
+        auto it = kernels_.find(key);
+        if (it != kernels_.end())
+            return it->second.get();
+    }
+
+    // Loading may compile the kernel, which must not block handles of other kernels.
+    // Platforms load each kernel once, so threads that race here get the same kernel.
+    auto kernel = platforms_[plat]->get_kernel(dev, file_name, kernel_name);
+    std::lock_guard<std::mutex> guard(kernels_lock_);
+    auto& handle = kernels_[key];
+    if (!handle)
+        handle.reset(new KernelHandle { plat, dev, file_name, kernel_name, kernel });
+    return handle.get();
+}
+
+void Runtime::launch_kernel_handle(KernelHandle* handle, const LaunchParams& launch_params) {
+    LaunchParams params = launch_params;
+    params.file_name = handle->file_name.c_str();
+    params.kernel_name = handle->kernel_name.c_str();
+    launch(handle->plat, handle->dev, nullptr, handle->kernel, params);
+    if (captured_graph && captured_graph->plat == handle->plat && captured_graph->dev == handle->dev)
+        capture_launch(captured_graph, handle, params);
+}
+
+ArgLayout::ArgLayout(const ParamsArgs& args, uint32_t num_args)
+    : offsets(num_args)
+    , sizes(args.sizes, args.sizes + num_args)
+    , aligns(args.aligns, args.aligns + num_args)
+    , alloc_sizes(args.alloc_sizes, args.alloc_sizes + num_args)
+    , types(args.types, args.types + num_args)
+    , size(0)
+    , align(1)
+{
+    for (uint32_t i = 0; i < num_args; ++i) {
+        if (aligns[i] == 0 || (aligns[i] & (aligns[i] - 1)) != 0)
+            error("Invalid alignment % for kernel argument %", aligns[i], i);
+        offsets[i] = (size + aligns[i] - 1) / aligns[i] * aligns[i];
+        size = offsets[i] + alloc_sizes[i];
+        align = std::max(align, aligns[i]);
+    }
+}
+
+bool ArgLayout::matches(const ParamsArgs& args, uint32_t num_args) const {
+    return num_args == this->num_args() &&
+        std::equal(sizes.begin(), sizes.end(), args.sizes) &&
+        std::equal(aligns.begin(), aligns.end(), args.aligns) &&
+        std::equal(alloc_sizes.begin(), alloc_sizes.end(), args.alloc_sizes) &&
+        std::equal(types.begin(), types.end(), args.types);
+}
+
+const ArgLayout& Runtime::kernel_layout(KernelHandle* handle, const ParamsArgs& args, uint32_t num_args) {
+    auto layout = handle->layout.load(std::memory_order_acquire);
+    if (!layout) {
+        auto created = new ArgLayout(args, num_args);
+        if (handle->layout.compare_exchange_strong(layout, created, std::memory_order_acq_rel))
+            return *created;
+        delete created;
+    }
+    if (!layout->matches(args, num_args))
+        error("The arguments of kernel '%' do not match the layout set for it", handle->kernel_name);
+    return *layout;
+}
+
+void Runtime::launch_kernel_packed(KernelHandle* handle, const uint32_t* grid, const uint32_t* block, const void* args) {
+    auto layout = handle->layout.load(std::memory_order_acquire);
+    if (!layout)
+        error("No argument layout is set for kernel '%'", handle->kernel_name);
+
+    // Platforms that launch the packed arguments as they are ignore these pointers, the other paths rely on them.
+    // Usual argument counts fit on the stack, so that launches do not allocate.
+    const uint32_t max_stack_args = 32;
+    auto num_args = layout->num_args();
+    void* stack_data[max_stack_args];
+    std::unique_ptr<void*[]> heap_data(num_args > max_stack_args ? new void*[num_args] : nullptr);
+    auto data = heap_data ? heap_data.get() : stack_data;
+    for (uint32_t i = 0; i < num_args; ++i)
+        data[i] = const_cast<char*>(static_cast<const char*>(args) + layout->offsets[i]);
+    LaunchParams params = {
+        handle->file_name.c_str(), handle->kernel_name.c_str(), grid, block,
+        { data, layout->sizes.data(), layout->aligns.data(), layout->alloc_sizes.data(), layout->types.data() },
+        num_args
+    };
+
+    // Evictable handles among the arguments must be replaced, which only the unpacked arguments allow
+    if (handle->kernel && num_evictables_.load(std::memory_order_relaxed) == 0) {
+        check_grid(params);
+        platforms_[handle->plat]->launch_kernel_packed(handle->dev, handle->kernel, *layout, args, params);
+    } else
+        launch(handle->plat, handle->dev, nullptr, handle->kernel, params);
+    if (captured_graph && captured_graph->plat == handle->plat && captured_graph->dev == handle->dev)
+        capture_launch(captured_graph, handle, params);
+}
+
+void Runtime::check_grid(const LaunchParams& launch_params) {
     assert(launch_params.grid[0] > 0 && launch_params.grid[0] % launch_params.block[0] == 0 &&
            launch_params.grid[1] > 0 && launch_params.grid[1] % launch_params.block[1] == 0 &&
            launch_params.grid[2] > 0 && launch_params.grid[2] % launch_params.block[2] == 0 &&
            "The grid size is not a multiple of the block size");
-    platforms_[plat]->launch_kernel(dev, launch_params);
+    (void)launch_params;
+}
+
+void Runtime::launch(PlatformId plat, DeviceId dev, void* stream, void* kernel, const LaunchParams& launch_params) {
+    check_grid(launch_params);
+    auto submit = [&] (const LaunchParams& params) {
+        if (kernel)
+            platforms_[plat]->launch_kernel_handle(dev, kernel, params);
+        else if (stream)
+            platforms_[plat]->launch_kernel_on(dev, stream, params);
+        else
+            platforms_[plat]->launch_kernel(dev, params);
+    };
+    if (num_evictables_.load(std::memory_order_relaxed) == 0)
+        return submit(launch_params);
+
+    // Pointer arguments that are evictable handles are replaced by their device buffers
+    EvictablePins pins(*this);
+    auto num_args = launch_params.num_args;
+    std::vector<void*> values(num_args);
+    std::vector<void*> data(launch_params.args.data, launch_params.args.data + num_args);
+    for (uint32_t i = 0; i < num_args; ++i) {
+        if (launch_params.args.types[i] != KernelArgType::Ptr)
+            continue;
+        auto ptr = *static_cast<void**>(data[i]);
+        values[i] = pins.resolve(plat, dev, ptr);
+        if (values[i] != ptr)
+            data[i] = &values[i];
+    }
+    LaunchParams params = launch_params;
+    params.args.data = data.data();
+    submit(params);
 }
 
 void Runtime::synchronize(PlatformId plat, DeviceId dev) {
@@ -117,6 +1104,209 @@ void Runtime::synchronize(PlatformId plat, DeviceId dev) {
     platforms_[plat]->synchronize(dev);
 }
 
+Stream* Runtime::stream_create(PlatformId plat, DeviceId dev) {
+    check_device(plat, dev);
+    return new Stream { plat, dev, platforms_[plat]->stream_create(dev) };
+}
+
+void Runtime::stream_destroy(Stream* stream) {
+    platforms_[stream->plat]->stream_destroy(stream->dev, stream->handle);
+    delete stream;
+}
+
+void Runtime::stream_synchronize(Stream* stream) {
+    platforms_[stream->plat]->stream_synchronize(stream->dev, stream->handle);
+}
+
+void Runtime::copy_async(Stream* stream,
+    PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+    PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size) {
+    check_device(plat_src, dev_src);
+    check_device(plat_dst, dev_dst);
+    auto plat = stream->plat;
+    auto dev = stream->dev;
+    bool from_stream = plat_src == plat && dev_src == dev;
+    bool to_stream   = plat_dst == plat && dev_dst == dev;
+
+    CopyKind kind;
+    if (from_stream && to_stream)
+        kind = CopyKind::DeviceToDevice;
+    else if (to_stream && plat_src == 0)
+        kind = CopyKind::HostToDevice;
+    else if (from_stream && plat_dst == 0)
+        kind = CopyKind::DeviceToHost;
+    else {
+        // Copies involving another device are ordered after the commands of the stream
+        stream_synchronize(stream);
+        return copy(plat_src, dev_src, src, offset_src, plat_dst, dev_dst, dst, offset_dst, size);
+    }
+
+    EvictablePins pins(*this);
+    src = pins.resolve(plat_src, dev_src, src);
+    dst = pins.resolve(plat_dst, dev_dst, dst);
+    platforms_[plat]->copy_async(dev, stream->handle, kind, CopyRegion { src, offset_src, dst, offset_dst, size });
+    debug("Asynchronous copy of % bytes on a stream of device % on platform %", size, dev, plat);
+}
+
+void Runtime::launch_kernel_on(Stream* stream, const LaunchParams& launch_params) {
+    launch(stream->plat, stream->dev, stream->handle, nullptr, launch_params);
+}
+
+void Runtime::capture_begin(PlatformId plat, DeviceId dev) {
+    check_device(plat, dev);
+    if (captured_graph)
+        error("A capture is already in progress on this thread");
+    captured_graph = new CommandGraph { plat, dev, {} };
+}
+
+CommandGraph* Runtime::capture_end() {
+    if (!captured_graph)
+        error("No capture is in progress on this thread");
+    auto graph = captured_graph;
+    captured_graph = nullptr;
+    debug("Captured % commands on device % of platform %", graph->commands.size(), graph->dev, graph->plat);
+    return graph;
+}
+
+void Runtime::capture_launch(CommandGraph* graph, KernelHandle* kernel, const LaunchParams& launch_params) {
+    CommandGraph::Launch launch;
+    launch.kernel = kernel;
+    std::copy_n(launch_params.grid, 3, launch.grid);
+    std::copy_n(launch_params.block, 3, launch.block);
+
+    // Arguments are stored at aligned offsets, pointers by their value
+    auto num_args = launch_params.num_args;
+    auto& args = launch_params.args;
+    std::vector<size_t> offsets(num_args);
+    size_t size = 0;
+    for (uint32_t i = 0; i < num_args; ++i) {
+        size_t align = std::max<size_t>(args.aligns[i], alignof(void*));
+        size_t arg_size = args.types[i] == KernelArgType::Ptr ? sizeof(void*) : args.sizes[i];
+        offsets[i] = (size + align - 1) / align * align;
+        size = offsets[i] + arg_size;
+    }
+    launch.args.resize(size);
+    launch.arg_data.resize(num_args);
+    for (uint32_t i = 0; i < num_args; ++i) {
+        launch.arg_data[i] = launch.args.data() + offsets[i];
+        size_t arg_size = args.types[i] == KernelArgType::Ptr ? sizeof(void*) : args.sizes[i];
+        std::memcpy(launch.arg_data[i], args.data[i], arg_size);
+    }
+    launch.arg_sizes.assign(args.sizes, args.sizes + num_args);
+    launch.arg_aligns.assign(args.aligns, args.aligns + num_args);
+    launch.arg_alloc_sizes.assign(args.alloc_sizes, args.alloc_sizes + num_args);
+    launch.arg_types.assign(args.types, args.types + num_args);
+
+    // Evictable handles must be resolved on every launch, which the platform cannot do
+    launch.recorded = num_evictables_.load(std::memory_order_relaxed) == 0
+        ? platforms_[kernel->plat]->record_launch(kernel->dev, kernel->kernel, launch.params())
+        : nullptr;
+    graph->commands.emplace_back(std::move(launch));
+}
+
+void Runtime::graph_launch(CommandGraph* graph, const GraphOverride* overrides, size_t num_overrides) {
+    for (size_t i = 0; i < num_overrides; ++i) {
+        auto& update = overrides[i];
+        if (update.command < 0 || size_t(update.command) >= graph->commands.size())
+            error("Invalid command % in graph of % commands", update.command, graph->commands.size());
+        auto& command = graph->commands[update.command];
+        if (auto copy = std::get_if<CommandGraph::Copy>(&command)) {
+            if (update.arg < 0 || size_t(update.arg) >= 2 * copy->regions.size())
+                error("Invalid argument % for copy % in graph", update.arg, update.command);
+            if (update.size != int64_t(sizeof(void*)))
+                error("Value of % bytes for pointer % of copy % in graph", update.size, update.arg, update.command);
+            auto& region = copy->regions[update.arg / 2];
+            if (update.arg % 2 == 0)
+                region.src = *static_cast<const void* const*>(update.value);
+            else
+                region.dst = *static_cast<void* const*>(update.value);
+            continue;
+        }
+        auto& launch = std::get<CommandGraph::Launch>(command);
+        if (update.arg < 0 || size_t(update.arg) >= launch.arg_data.size())
+            error("Invalid argument % for launch % in graph", update.arg, update.command);
+        size_t arg_size = launch.arg_types[update.arg] == KernelArgType::Ptr ? sizeof(void*) : launch.arg_sizes[update.arg];
+        if (update.size != int64_t(arg_size))
+            error("Value of % bytes for argument % of launch % in graph, which has % bytes", update.size, update.arg, update.command, arg_size);
+        std::memcpy(launch.arg_data[update.arg], update.value, arg_size);
+        if (launch.recorded)
+            platforms_[launch.kernel->plat]->update_launch(launch.kernel->dev, launch.recorded, launch.params(), update.arg);
+    }
+
+    bool has_evictables = num_evictables_.load(std::memory_order_relaxed) > 0;
+    for (auto& command : graph->commands) {
+        if (auto copy = std::get_if<CommandGraph::Copy>(&command)) {
+            if (copy->regions.size() == 1) {
+                auto& region = copy->regions.front();
+                this->copy(
+                    copy->plat_src, copy->dev_src, region.src, region.offset_src,
+                    copy->plat_dst, copy->dev_dst, region.dst, region.offset_dst, region.size);
+            } else {
+                // Batches merge and reorder their regions, which must be kept for later replays
+                auto regions = copy->regions;
+                copy_batch(copy->plat_src, copy->dev_src, copy->plat_dst, copy->dev_dst, regions);
+            }
+            continue;
+        }
+        auto& launch = std::get<CommandGraph::Launch>(command);
+        if (launch.recorded && !has_evictables)
+            platforms_[launch.kernel->plat]->replay_launch(launch.kernel->dev, launch.recorded, launch.params());
+        else
+            launch_kernel_handle(launch.kernel, launch.params());
+    }
+}
+
+void Runtime::graph_destroy(CommandGraph* graph) {
+    for (auto& command : graph->commands) {
+        if (auto launch = std::get_if<CommandGraph::Launch>(&command)) {
+            if (launch->recorded)
+                platforms_[launch->kernel->plat]->release_launch(launch->kernel->dev, launch->recorded);
+        }
+    }
+    delete graph;
+}
+
+Event* Runtime::event_create(PlatformId plat, DeviceId dev) {
+    check_device(plat, dev);
+    return new Event { plat, dev, platforms_[plat]->event_create(dev) };
+}
+
+void Runtime::event_destroy(Event* event) {
+    platforms_[event->plat]->event_destroy(event->dev, event->handle);
+    delete event;
+}
+
+void Runtime::event_record(Event* event, Stream* stream) {
+    if (stream && (stream->plat != event->plat || stream->dev != event->dev))
+        error("Cannot record an event of device % on platform % on a stream of device % on platform %", event->dev, event->plat, stream->dev, stream->plat);
+    platforms_[event->plat]->event_record(event->dev, stream ? stream->handle : nullptr, event->handle);
+}
+
+void Runtime::event_wait(Event* event, Stream* stream) {
+    PlatformId plat = stream ? stream->plat : event->plat;
+    DeviceId dev = stream ? stream->dev : event->dev;
+    if (plat != event->plat || dev != event->dev) {
+        // Queues of different devices cannot wait on each other's events
+        debug("Waiting on the host for an event of device % on platform %", event->dev, event->plat);
+        return event_synchronize(event);
+    }
+    platforms_[plat]->event_wait(dev, stream ? stream->handle : nullptr, event->handle);
+}
+
+bool Runtime::event_query(Event* event) {
+    return platforms_[event->plat]->event_query(event->dev, event->handle);
+}
+
+void Runtime::event_synchronize(Event* event) {
+    platforms_[event->plat]->event_synchronize(event->dev, event->handle);
+}
+
+int64_t Runtime::event_elapsed(Event* start, Event* end) {
+    if (start->plat != end->plat || start->dev != end->dev)
+        error("Cannot measure the time between events of different devices");
+    return platforms_[start->plat]->event_elapsed(start->dev, start->handle, end->handle);
+}
+
 #ifdef _WIN32
 #include <direct.h>
 #define PATH_DIR_SEPARATOR '\\'
@@ -5,13 +5,19 @@
 #include <cstddef>
 #include <cstdlib>
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
 #include <string>
+#include <tuple>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 #include <atomic>
 #include <memory>
 
 #include "log.h"
+#include "hash.h"
 
 enum DeviceId   : uint32_t {};
 enum PlatformId : uint32_t {};
@@ -21,6 +27,76 @@ class Platform;
 
 enum class KernelArgType : uint8_t { Val = 0, Ptr, Struct };
 
+/// Properties of an `anydsl_alloc_ex()` allocation, must match `anydsl_alloc_props`.
+struct AllocProps {
+    enum Flags : int32_t { ZeroInit = 1 << 0, HugePages = 1 << 1, Pinned = 1 << 2, NumaNode = 1 << 3, Snapshots = 1 << 4 };
+    enum Usage : int32_t { ReadWrite = 0, ReadOnly, WriteOnly };
+
+    int64_t alignment;
+    int32_t flags;
+    int32_t numa_node;
+    int32_t usage;
+};
+
+/// Flags passed to `anydsl_host_register()`, must match the `ANYDSL_HOST_REGISTER_*` constants.
+enum HostRegisterFlags : int32_t { HostRegisterReadOnly = 1 << 0 };
+
+/// Hints passed to `anydsl_mem_advise()`, must match the `ANYDSL_ADVICE_*` constants.
+enum class MemAdvice : int32_t { ReadMostly = 0, PreferredLocation, AccessedBy, Sequential, Random, WillNeed, DontNeed };
+
+/// A memory region copied by `Runtime::copy_batch()`.
+struct CopyRegion {
+    const void* src;
+    int64_t offset_src;
+    void* dst;
+    int64_t offset_dst;
+    int64_t size;
+};
+
+/// Direction of a batch of copies, as seen by the platform performing them.
+enum class CopyKind : uint8_t { DeviceToDevice = 0, HostToDevice, DeviceToHost };
+
+/// Element types understood by `anydsl_copy_convert()`, must match the `ANYDSL_TYPE_*` constants.
+enum class ElemType : int32_t { U8 = 0, F16, BF16, F32 };
+
+/// Layout of a pitched buffer, in bytes between consecutive rows and slices.
+struct Pitch {
+    int64_t row;
+    int64_t slice;
+};
+
+/// A box copied by `anydsl_copy_3d()`, must match `anydsl_region_3d`. The x coordinates and the width are in bytes.
+struct Region3D {
+    int64_t src_x, src_y, src_z;
+    int64_t dst_x, dst_y, dst_z;
+    int64_t width, height, depth;
+};
+
+/// Splits a 3D copy into one region per row, or a single region when the rows are contiguous.
+inline std::vector<CopyRegion> row_regions(const void* src, Pitch src_pitch, void* dst, Pitch dst_pitch, const Region3D& region) {
+    std::vector<CopyRegion> rows;
+    bool contiguous =
+        region.width == src_pitch.row && region.width == dst_pitch.row &&
+        region.height * src_pitch.row == src_pitch.slice && region.height * dst_pitch.row == dst_pitch.slice;
+    if (contiguous) {
+        rows.push_back(CopyRegion {
+            src, region.src_z * src_pitch.slice + region.src_y * src_pitch.row,
+            dst, region.dst_z * dst_pitch.slice + region.dst_y * dst_pitch.row,
+            region.width * region.height * region.depth });
+        return rows;
+    }
+    rows.reserve(region.height * region.depth);
+    for (int64_t z = 0; z < region.depth; ++z) {
+        for (int64_t y = 0; y < region.height; ++y) {
+            rows.push_back(CopyRegion {
+                src, (region.src_z + z) * src_pitch.slice + (region.src_y + y) * src_pitch.row + region.src_x,
+                dst, (region.dst_z + z) * dst_pitch.slice + (region.dst_y + y) * dst_pitch.row + region.dst_x,
+                region.width });
+        }
+    }
+    return rows;
+}
+
 struct ParamsArgs {
     void** data;
     const uint32_t* sizes;
@@ -39,9 +115,138 @@ struct LaunchParams {
     uint32_t num_args;
 };
 
+/// The arguments of a kernel packed in one buffer, where argument `i` is at `offsets[i]`, a multiple of its alignment,
+/// and takes `alloc_sizes[i]` bytes. Computed once per kernel handle, and shared by all launches with packed arguments.
+struct ArgLayout {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> aligns;
+    std::vector<uint32_t> alloc_sizes;
+    std::vector<KernelArgType> types;
+    /// Size of the packed arguments, and alignment of the buffer holding them.
+    uint32_t size;
+    uint32_t align;
+
+    ArgLayout(const ParamsArgs& args, uint32_t num_args);
+
+    uint32_t num_args() const { return uint32_t(offsets.size()); }
+    /// Returns whether the arguments have the sizes, alignments, and types of this layout.
+    bool matches(const ParamsArgs& args, uint32_t num_args) const;
+};
+
+/// A bump allocator that sub-allocates from a single device allocation.
+/// All allocations made from an arena are released at once by `Runtime::arena_reset()` or `Runtime::arena_destroy()`.
+/// Arenas are not thread-safe, and require a device with `Platform::has_addressable_memory()`.
+struct Arena {
+    PlatformId plat;
+    DeviceId dev;
+    char* data;
+    int64_t capacity;
+    int64_t offset;
+};
+
+/// A buffer with one copy on the host and one on a device, which are only synchronized when the acquired side is stale.
+/// Each side has a version that is bumped when it is acquired for writing, and only the ranges written on the most recent side
+/// since the last synchronization are copied. On the CPU platform, both sides share the same memory.
+struct Mirror {
+    enum Side : int32_t { Host = 0, Device = 1 };
+    enum Access : int32_t { Read = 1 << 0, Write = 1 << 1 };
+
+    PlatformId plat;
+    DeviceId dev;
+    int64_t size;
+    void* data[2];
+    uint64_t versions[2];
+    /// Sorted and disjoint `[begin, end)` ranges written on the most recent side.
+    std::vector<std::pair<int64_t, int64_t>> dirty;
+    std::mutex lock;
+};
+
+/// A queue of copies and kernel launches on a device, which run in order and asynchronously with the host.
+/// The handle is given by the platform, and is `nullptr` for platforms that only have one queue per device.
+struct Stream {
+    PlatformId plat;
+    DeviceId dev;
+    void* handle;
+};
+
+/// A point in the commands issued on a device, which is used to order streams and to time commands.
+struct Event {
+    PlatformId plat;
+    DeviceId dev;
+    void* handle;
+};
+
+/// A kernel loaded by `Runtime::get_kernel()`, which is launched without looking it up by name again.
+struct KernelHandle {
+    PlatformId plat;
+    DeviceId dev;
+    std::string file_name;
+    std::string kernel_name;
+    /// The kernel given by `Platform::get_kernel()`, or `nullptr` for platforms that launch kernels by name.
+    void* kernel;
+    /// The layout of packed arguments, set once by `Runtime::kernel_layout()`.
+    std::atomic<ArgLayout*> layout { nullptr };
+
+    ~KernelHandle() { delete layout.load(); }
+};
+
+/// Replaces an argument of a captured command, must match `anydsl_graph_override`.
+/// The value of a kernel argument has the size of the argument, or of a pointer for buffers.
+/// The arguments of a copy are the source (2 * i) and destination (2 * i + 1) pointers of its regions.
+struct GraphOverride {
+    int32_t command;
+    int32_t arg;
+    const void* value;
+    /// Size of the value in bytes, which must match the size of the argument.
+    int64_t size;
+};
+
+/// Kernel launches and copies captured by `Runtime::capture_begin()`, replayed without loading kernels or decoding arguments again.
+/// Unrelated to the task graphs of `anydsl_create_graph()`.
+struct CommandGraph {
+    /// A call to `Runtime::copy()`, with a single region, or to `Runtime::copy_batch()`.
+    struct Copy {
+        PlatformId plat_src;
+        DeviceId dev_src;
+        PlatformId plat_dst;
+        DeviceId dev_dst;
+        std::vector<CopyRegion> regions;
+    };
+
+    /// A launch whose arguments are stored in `args`, at the addresses of `arg_data`.
+    struct Launch {
+        /// The kernel, resolved with `Runtime::get_kernel()` when the launch is captured.
+        KernelHandle* kernel;
+        uint32_t grid[3];
+        uint32_t block[3];
+        std::vector<char> args;
+        std::vector<void*> arg_data;
+        std::vector<uint32_t> arg_sizes;
+        std::vector<uint32_t> arg_aligns;
+        std::vector<uint32_t> arg_alloc_sizes;
+        std::vector<KernelArgType> arg_types;
+        /// The launch prepared by the platform with `Platform::record_launch()`, or `nullptr`.
+        void* recorded;
+
+        LaunchParams params() {
+            return LaunchParams {
+                kernel->file_name.c_str(), kernel->kernel_name.c_str(), grid, block,
+                { arg_data.data(), arg_sizes.data(), arg_aligns.data(), arg_alloc_sizes.data(), arg_types.data() },
+                uint32_t(arg_data.size())
+            };
+        }
+    };
+
+    PlatformId plat;
+    DeviceId dev;
+    std::vector<std::variant<Copy, Launch>> commands;
+};
+
 class Runtime {
 public:
     Runtime(std::pair<ProfileLevel, ProfileLevel>);
+    ~Runtime();
 
     /// Registers the given platform into the runtime.
     template <typename T, typename... Args>
@@ -59,6 +264,8 @@ public:
 
     /// Allocates memory on the given device.
     void* alloc(PlatformId plat, DeviceId dev, int64_t size);
+    /// Allocates memory on the given device, with the given alignment, initialization, and placement properties.
+    void* alloc_ex(PlatformId plat, DeviceId dev, int64_t size, const AllocProps& props);
     /// Allocates page-locked memory on the given platform and device.
     void* alloc_host(PlatformId plat, DeviceId dev, int64_t size);
     /// Allocates unified memory on the given platform and device.
@@ -67,17 +274,139 @@ public:
     void* get_device_ptr(PlatformId plat, DeviceId dev, void* ptr);
     /// Releases memory.
     void release(PlatformId plat, DeviceId dev, void* ptr);
+    /// Releases memory once the work submitted to the device so far has completed, without waiting for it.
+    void release_deferred(PlatformId plat, DeviceId dev, void* ptr);
     /// Releases previously allocated page-locked memory.
     void release_host(PlatformId plat, DeviceId dev, void* ptr);
+    /// Creates host memory that other processes can map by name with `open_shared()`.
+    /// The name is removed when the creator releases the memory, and other processes keep their mappings.
+    void* alloc_shared(const char* name, int64_t size, int32_t flags);
+    /// Maps host memory created by another process with `alloc_shared()`, and returns its size.
+    void* open_shared(const char* name, int64_t& size);
+    /// Reserves room for a buffer of up to `max_size` bytes, whose memory is committed on demand.
+    void* alloc_reserve(PlatformId plat, DeviceId dev, int64_t max_size);
+    /// Commits memory for the first `size` bytes of a reserved buffer, without moving it.
+    void commit(PlatformId plat, DeviceId dev, void* ptr, int64_t size);
+    /// Frees the memory of a reserved buffer past its first `size` bytes, and keeps the room reserved.
+    void decommit(PlatformId plat, DeviceId dev, void* ptr, int64_t size);
+    /// Resizes a buffer, and returns its new address. The contents are preserved up to the smaller size.
+    void* realloc(PlatformId plat, DeviceId dev, void* ptr, int64_t old_size, int64_t new_size);
+    /// Returns a copy of the given memory range, which is released with `release()`.
+    /// Platforms that support it share the pages of the copy with the original until either is modified.
+    void* snapshot(PlatformId plat, DeviceId dev, const void* ptr, int64_t size);
+    /// Allocates a device buffer that is moved to the host when the device runs out of memory, and returns a handle to it.
+    /// Kernel launches, copies, and fills accept the handle in place of a pointer, and restore the buffer first if it was evicted.
+    /// The handle is released with `release()`.
+    void* alloc_evictable(PlatformId plat, DeviceId dev, int64_t size);
+    /// Page-locks existing host memory and makes it accessible from the device. Returns false if the platform cannot register it.
+    bool host_register(PlatformId plat, DeviceId dev, void* ptr, int64_t size, int32_t flags);
+    /// Unregisters host memory registered with `host_register()`.
+    void host_unregister(PlatformId plat, DeviceId dev, void* ptr);
+    /// Uploads read-only data to a device, or returns the buffer of a previous upload with the same contents.
+    /// Buffers are shared, reference-counted, and must not be written to.
+    void* upload_constant(PlatformId plat, DeviceId dev, const void* host, int64_t size);
+    /// Drops a reference to a buffer returned by `upload_constant()`, and releases it when it is no longer used.
+    void release_constant(PlatformId plat, DeviceId dev, void* ptr);
+    /// Creates an arena backed by a single allocation of the given capacity on the given device.
+    Arena* arena_create(PlatformId plat, DeviceId dev, int64_t capacity);
+    /// Allocates memory from an arena. Returns `nullptr` if the arena is exhausted.
+    void* arena_alloc(Arena* arena, int64_t size, int64_t align);
+    /// Releases every allocation made from the arena, but keeps its backing memory.
+    void arena_reset(Arena* arena);
+    /// Destroys the arena and releases its backing memory.
+    void arena_destroy(Arena* arena);
+    /// Creates a buffer mirrored on the host and on the given device.
+    Mirror* mirror_create(PlatformId plat, DeviceId dev, int64_t size);
+    /// Returns one side of a mirrored buffer, after copying the ranges it misses from the other side.
+    /// Acquiring a side for writing marks the given range as modified.
+    void* mirror_acquire(Mirror* mirror, Mirror::Side side, int32_t access, int64_t offset, int64_t size);
+    /// Releases both sides of a mirrored buffer.
+    void mirror_destroy(Mirror* mirror);
+    /// Gives the platform a hint on how the given memory range will be accessed by the device.
+    void mem_advise(PlatformId plat, DeviceId dev, void* ptr, int64_t size, MemAdvice advice);
+    /// Starts moving the given memory range closer to the device, without waiting for completion.
+    void mem_prefetch(PlatformId plat, DeviceId dev, void* ptr, int64_t size);
     /// Copies memory between devices.
     void copy(
         PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
         PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size);
 
+    /// Allocates a 3D buffer whose rows are padded to the preferred alignment of the device, and returns the row pitch in bytes.
+    void* alloc_pitched(PlatformId plat, DeviceId dev, int64_t width, int64_t height, int64_t depth, int64_t& pitch);
+    /// Copies a box between two pitched buffers.
+    void copy_3d(
+        PlatformId plat_src, DeviceId dev_src, const void* src, Pitch src_pitch,
+        PlatformId plat_dst, DeviceId dev_dst, void* dst, Pitch dst_pitch,
+        const Region3D& region);
+    /// Copies `count` elements between devices, converting them to another type and applying `value * scale + bias` on the way.
+    /// The conversion happens on the host, while the data is staged.
+    void copy_convert(
+        PlatformId plat_src, DeviceId dev_src, const void* src, ElemType src_type,
+        PlatformId plat_dst, DeviceId dev_dst, void* dst, ElemType dst_type,
+        int64_t count, float scale, float bias);
+    /// Copies a batch of non-overlapping regions between two devices, waiting only once for their completion.
+    /// Adjacent regions are merged, and the order of the regions is modified.
+    void copy_batch(
+        PlatformId plat_src, DeviceId dev_src,
+        PlatformId plat_dst, DeviceId dev_dst,
+        std::vector<CopyRegion>& regions);
+    /// Fills memory with a pattern of `pattern_size` bytes, which must be a power of two not larger than 128.
+    void memset(PlatformId plat, DeviceId dev, void* ptr, int64_t offset, const void* pattern, int64_t pattern_size, int64_t size);
+
     /// Launches a kernel on the platform and device.
     void launch_kernel(PlatformId plat, DeviceId dev, const LaunchParams& launch_params);
     /// Waits for the completion of all kernels on the given platform and device.
     void synchronize(PlatformId plat, DeviceId dev);
+    /// Loads a kernel, and returns a handle to it that stays valid as long as the runtime.
+    /// Handles are shared between the calls with the same device, file, and kernel names.
+    KernelHandle* get_kernel(PlatformId plat, DeviceId dev, const char* file_name, const char* kernel_name);
+    /// Launches a kernel loaded by `get_kernel()`. The file and kernel names of the launch parameters are ignored.
+    void launch_kernel_handle(KernelHandle* handle, const LaunchParams& launch_params);
+    /// Sets the layout of the packed arguments of a kernel handle, or checks that the arguments match it if it is already set.
+    const ArgLayout& kernel_layout(KernelHandle* handle, const ParamsArgs& args, uint32_t num_args);
+    /// Launches a kernel handle with its arguments packed in one buffer, following the layout set by `kernel_layout()`.
+    void launch_kernel_packed(KernelHandle* handle, const uint32_t* grid, const uint32_t* block, const void* args);
+
+    /// Creates a stream on the given device. Its commands are not ordered with the commands issued without a stream,
+    /// but `synchronize()` waits for both.
+    Stream* stream_create(PlatformId plat, DeviceId dev);
+    /// Waits for the commands of the stream, and destroys it.
+    void stream_destroy(Stream* stream);
+    /// Waits for the completion of the commands of the stream.
+    void stream_synchronize(Stream* stream);
+    /// Enqueues a copy between the device of the stream and the host, or within the device of the stream.
+    /// Host memory must stay valid and unmodified until the stream is synchronized.
+    /// Other copies wait for the stream and are done immediately.
+    void copy_async(Stream* stream,
+        PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+        PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size);
+    /// Enqueues a kernel launch on the stream.
+    void launch_kernel_on(Stream* stream, const LaunchParams& launch_params);
+
+    /// Starts capturing the kernel launches, `copy()` and `copy_batch()` calls made by the calling thread that involve the given device.
+    /// Captured commands still run.
+    void capture_begin(PlatformId plat, DeviceId dev);
+    /// Stops the capture of the calling thread, and returns the captured commands.
+    CommandGraph* capture_end();
+    /// Replays captured commands, after replacing the given arguments, which keep their new values in later replays.
+    void graph_launch(CommandGraph* graph, const GraphOverride* overrides, size_t num_overrides);
+    void graph_destroy(CommandGraph* graph);
+
+    /// Creates an event on the given device.
+    Event* event_create(PlatformId plat, DeviceId dev);
+    void event_destroy(Event* event);
+    /// Records the event after the commands issued so far on the stream, or without a stream if it is `nullptr`.
+    /// The stream must be on the device of the event.
+    void event_record(Event* event, Stream* stream);
+    /// Makes the commands issued next on the stream, or without a stream if it is `nullptr`, wait for the event.
+    /// The host only blocks for events of another device.
+    void event_wait(Event* event, Stream* stream);
+    /// Returns whether the commands before the event have completed.
+    bool event_query(Event* event);
+    /// Waits for the commands before the event to complete.
+    void event_synchronize(Event* event);
+    /// Returns the time between two events of the same device in nanoseconds, after waiting for them.
+    int64_t event_elapsed(Event* start, Event* end);
 
     /// Associate a program string to a given filename.
     void register_file(const std::string& filename, const std::string& program_string) {
@@ -104,13 +433,111 @@ public:
 
 private:
     void check_device(PlatformId, DeviceId) const;
+    static void check_grid(const LaunchParams& launch_params);
+    /// Launches a kernel on a stream of the device, or without a stream if it is `nullptr`.
+    /// The kernel is given by the platform handle `kernel` if it is not `nullptr`, by its name otherwise.
+    void launch(PlatformId plat, DeviceId dev, void* stream, void* kernel, const LaunchParams& launch_params);
+    /// Adds a launch to the graph captured by the calling thread.
+    void capture_launch(CommandGraph* graph, KernelHandle* kernel, const LaunchParams& launch_params);
+    /// Copies memory between devices, like `copy()`, without adding the copy to the graph captured by the calling thread.
+    void transfer(
+        PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+        PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size);
+
+    /// Returns whether the given host range lies in page-locked memory allocated by the given platform.
+    bool is_pinned(PlatformId plat, const void* ptr, int64_t size);
+    void* acquire_staging_buffer(PlatformId plat, DeviceId dev);
+    void release_staging_buffer(PlatformId plat, DeviceId dev, void* buffer);
+    /// Copies pageable host memory to a device, by chunks, through a pair of page-locked staging buffers.
+    void copy_staged_from_host(const char* src, PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size);
+    /// Copies device memory to pageable host memory, by chunks, through a pair of page-locked staging buffers.
+    void copy_staged_to_host(PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src, char* dst, int64_t size);
+    /// Copies memory between devices of different platforms, by chunks, through a pair of host staging buffers.
+    void copy_staged(
+        PlatformId plat_src, DeviceId dev_src, const void* src, int64_t offset_src,
+        PlatformId plat_dst, DeviceId dev_dst, void* dst, int64_t offset_dst, int64_t size);
     std::string get_cached_filename(const std::string& str, const std::string& ext) const;
 
+    /// A buffer allocated with `alloc_evictable()`, identified by the address of this structure.
+    struct Evictable {
+        PlatformId plat;
+        DeviceId dev;
+        int64_t size;
+        /// The device buffer, or `nullptr` while the contents are evicted to `host`.
+        void* device;
+        void* host;
+        /// Number of operations being issued with the device buffer, which cannot be evicted until they are.
+        int32_t pins;
+        std::list<Evictable*>::iterator lru;
+    };
+
+    /// Replaces evictable handles by their device buffers for the duration of an operation.
+    struct EvictablePins {
+        Runtime& runtime;
+        std::vector<Evictable*> buffers;
+
+        EvictablePins(Runtime& runtime) : runtime(runtime) {}
+        ~EvictablePins();
+        /// Returns the device buffer of an evictable handle, after restoring it if needed, or the pointer itself.
+        void* resolve(PlatformId plat, DeviceId dev, const void* ptr);
+    };
+
+    bool evictable_mode() const { return memory_limit_ > 0 || num_evictables_.load(std::memory_order_relaxed) > 0; }
+    /// The following functions must be called with `evict_lock_` held.
+    /// Allocates device memory, evicting the least recently used evictable buffers of the device while the allocation fails.
+    void* alloc_or_evict(PlatformId plat, DeviceId dev, int64_t size);
+    /// Evicts buffers until an allocation of the given size fits in the memory limit of the device.
+    void reserve_memory(PlatformId plat, DeviceId dev, int64_t size);
+    /// Copies the least recently used unpinned buffer of the device to the host, and releases its device memory.
+    bool evict_one(PlatformId plat, DeviceId dev);
+    void restore(Evictable* evictable);
+    /// Releases an evictable buffer, or returns false if the pointer is not an evictable handle.
+    /// Deferred releases keep the device buffer alive until the work queued on the device completes.
+    bool release_evictable(PlatformId plat, DeviceId dev, void* ptr, bool deferred);
+    void track_allocation(PlatformId plat, DeviceId dev, void* ptr, int64_t size);
+    void untrack_allocation(PlatformId plat, DeviceId dev, void* ptr);
+
     std::pair<ProfileLevel, ProfileLevel> profile_;
     std::atomic<uint64_t> kernel_time_;
     std::vector<std::unique_ptr<Platform>> platforms_;
     std::unordered_map<std::string, std::string> files_;
     std::string cache_dir_;
+
+    struct PinnedRange {
+        int64_t size;
+        PlatformId plat;
+    };
+
+    std::mutex pinned_lock_;
+    std::map<uintptr_t, PinnedRange> pinned_;
+    std::mutex staging_lock_;
+    std::unordered_map<uint64_t, std::vector<void*>> staging_buffers_;
+
+    /// Constants are identified by their device, size, and the 128-bit hash of their contents, and buffers map back to their key for `release_constant()`.
+    /// Collisions of the hash are unlikely enough that contents are not compared, which would require a host copy of every constant.
+    typedef std::tuple<PlatformId, DeviceId, int64_t, Hash128> ConstantKey;
+    struct Constant {
+        void* ptr;
+        int64_t refs;
+    };
+
+    std::mutex constants_lock_;
+    std::map<ConstantKey, Constant> constants_;
+    std::map<std::tuple<PlatformId, DeviceId, void*>, ConstantKey> constant_keys_;
+
+    std::mutex kernels_lock_;
+    std::map<std::tuple<PlatformId, DeviceId, std::string, std::string>, std::unique_ptr<KernelHandle>> kernels_;
+
+    /// Per-device limit set with `ANYDSL_DEVICE_MEMORY_LIMIT`, in bytes. Allocations beyond it fail as if the device was full.
+    int64_t memory_limit_;
+    std::mutex evict_lock_;
+    std::atomic<size_t> num_evictables_;
+    std::unordered_map<const void*, std::unique_ptr<Evictable>> evictables_;
+    /// Evictable buffers that are on their device, from the most to the least recently used.
+    std::list<Evictable*> lru_;
+    /// Memory allocated per device and size of each allocation, only tracked under a memory limit.
+    std::unordered_map<uint64_t, int64_t> memory_used_;
+    std::map<std::tuple<PlatformId, DeviceId, void*>, int64_t> allocation_sizes_;
 };
 
 #endif